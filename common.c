@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 //Needed by kpd_print_entry
 #define BLACK           "\x1b[00;30m"
@@ -30,46 +31,186 @@
 #define BRIGHT_WHITE    "\x1b[01;37m"
 #define DEFAULT         "\x1b[0m"
 
-//Needed by kpd_read_target
-static bool kpd_read_line(struct Entry *entry, struct CharBuffer *line)
+//Keywords, also used by complete.c
+const char *const kpd_action_strings[6] = { "commit", "remove", "done", "undo", "priority", "edit" };
+const char *const kpd_status_strings[3] = { "all", "open", "done" };
+const char *const kpd_priority_strings[4] = { "low", "medium", "high", "critical" };
+const char *const kpd_format_strings[4] = { "text", "json", "ndjson", "tsv" };
+const char *const kpd_input_strings[3] = { "lines", "csv", "ndjson" };
+
+//Needed by kpd_read_target and kpd_write_target
+static enum Source kpd_source = SRC_FILE;
+static const struct EntryBuffer *kpd_source_entries = NULL;
+static const char *kpd_section = NULL;              //Name of section, NULL for whole file
+static size_t kpd_section_begin = 0;                //Offset of first line after section heading
+static size_t kpd_section_end = 0;                  //Offset of next section heading or end of file
+static struct CharBuffer kpd_section_before = { 0 }; //Lines up to section contents (SRC_STDIN only)
+static struct CharBuffer kpd_section_after = { 0 };  //Heading of next section (SRC_STDIN only)
+
+//Needed by kpd_create_mask_highest_open and kpd_create_mask_last_closed
+static const struct Query *kpd_query = NULL;
+
+static char *kpd_create_mask_query(const struct EntryBuffer *entries)
 {
-    //Empty lines
-    if (strspn(line->p, " \t\n\r") == line->size) return false;
+    char *mask = malloc(entries->size + 1);
+    if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    if (query_select(mask, kpd_query, entries) == 0) kpd_error(ERR_USAGE, "no entries match query");
+    return mask;
+}
 
-    //Parse beginning
-    if (line->size < 7
-    || line->p[0] != ' '
-    || line->p[1] != '-'
-    || line->p[2] != ' '
-    || line->p[3] != '['
-    || (line->p[4] != ' ' && line->p[4] != 'X')
-    || line->p[5] != ']'
-    || line->p[6] != ' ') kpd_error(ERR_FORMAT, "invalid line '%s'", line->p);
-    entry->done = line->p[4] == 'X';
-    
-    //Parse priority
-    entry->priority = PRI_MEDIUM;
-    entry->priority_explicit = false;
-    const char *markers[4] = { "(priority: low)", "(priority: medium)", "(priority: high)", "(priority: critical)" };
-    for (enum Priority priority = 0; priority < 4; priority++)
+//Needed by kpd_find_target, kpd_read_target and kpd_read_store
+static FILE *kpd_open_target(struct CharBuffer *path)
+{
+    //Search for TODO.md
+    size_t step = 0;
+    struct CharBuffer local_path = { 0 };
+    string_set_cwd(&local_path);
+    string_append_file(&local_path);
+    FILE *local_file = NULL;
+    while (true)
     {
-        char *marker_found = strstr(line->p, markers[priority]);
-        if (marker_found != NULL)
+        local_file = fopen(local_path.p, "r+");
+        if (local_file != NULL) break;
+        if (!string_remove_file(&local_path) || !string_remove_file(&local_path))
+            kpd_error(ERR_USAGE, "current_string directory does not contain " TARGET);
+        string_append_file(&local_path);
+        step++;
+    }
+
+    //Make relative path
+    if (path != NULL)
+    {
+        string_set_size(&local_path, 0);
+        if (step == 0)
         {
-            //Remove marker
-            entry->priority = priority;
-            entry->priority_explicit = true;
-            string_substitute(line, (size_t)(marker_found - line->p), strlen(markers[priority]), "", 0);
-            break;
+            string_substitute(&local_path, 0, 0, TARGET, strlen(TARGET));
+        }
+        else
+        {
+            for (size_t i = 0; i < step; i++) string_substitute(&local_path, local_path.size, 0, "../", 3);
+            string_append_file(&local_path);
         }
     }
 
-    //Allocate
-    string_trim(line, 7, 0); //Not really efficient
-    entry->description = malloc(line->size + 1);
-    if (entry->description == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
-    memcpy(entry->description, line->p, line->size + 1);
-    return true;
+    //Cleanup
+    if (path == NULL) string_finalize(&local_path);
+    else *path = local_path;
+    return local_file;
+}
+
+//Needed by kpd_read_target and kpd_read_store
+static size_t kpd_heading_level(const struct CharBuffer *line)
+{
+    const size_t level = strspn(line->p, "#");
+    if (level == 0 || level > 6) return 0;
+    return (strchr(" \t\n\r", line->p[level]) != NULL) ? level : 0; //Also matches '\0'
+}
+
+static bool kpd_heading_match(const struct CharBuffer *line, size_t level, const char *name)
+{
+    const char *begin = line->p + level + strspn(line->p + level, " \t");
+    const char *end = line->p + line->size;
+    while (end > begin && strchr(" \t\n\r", end[-1]) != NULL) end--;
+    const size_t name_length = strlen(name);
+    return (size_t)(end - begin) == name_length && strncasecmp(begin, name, name_length) == 0;
+}
+
+static void kpd_parse_target(FILE *file, struct EntryBuffer *entries, struct EntryStore *store)
+{
+    struct CharBuffer line = { 0 };
+    string_set_size(&line, INITIAL_BUFFER_SIZE);
+    size_t number = 0;
+    size_t offset = 0;
+    size_t section_level = 0;
+    bool section_found = false;
+    size_t first = 0;
+    while (string_set_line(&line, file))
+    {
+        //Only scan headings outside of section
+        if (kpd_section != NULL)
+        {
+            const size_t level = kpd_heading_level(&line);
+            if (!section_found)
+            {
+                offset += line.size;
+                if (kpd_source == SRC_STDIN) string_substitute(&kpd_section_before, kpd_section_before.size, 0, line.p, line.size);
+                if (level > 0 && kpd_heading_match(&line, level, kpd_section))
+                {
+                    section_found = true;
+                    section_level = level;
+                    kpd_section_begin = offset;
+                }
+                else
+                {
+                    //Tasks before section count for numbers in dependency markers
+                    struct Entry entry;
+                    if (kpd_read_line(&entry, &line)) first++;
+                }
+                continue;
+            }
+            else if (level > 0 && level <= section_level)
+            {
+                if (kpd_source == SRC_STDIN) string_substitute(&kpd_section_after, 0, 0, line.p, line.size);
+                break;
+            }
+        }
+        offset += line.size;
+
+        //Parse tasks, keep other lines verbatim
+        struct Entry entry = { 0 };
+        entry.number = number;
+        if (!kpd_read_line(&entry, &line))
+        {
+            if (entries == NULL) continue;
+            string_substitute(&entries->opaque, entries->opaque.size, 0, line.p, line.size);
+            if (line.p[line.size - 1] != '\n') string_substitute(&entries->opaque, entries->opaque.size, 0, "\n", 1);
+            continue;
+        }
+        if (entries != NULL)
+        {
+            entry.offset = entries->opaque.size;
+            entry.description = strdup(entry.description);
+            if (entry.description == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+            entries_set_size(entries, number + 1);
+            entries->p[number] = entry;
+        }
+        if (store != NULL) store_push(store, &entry);
+        number++;
+    }
+    if (kpd_section != NULL && !section_found) kpd_error(ERR_USAGE, "section '%s' not found", kpd_section);
+    kpd_section_end = offset;
+    if (entries != NULL) entries->first = first;
+    if (store != NULL) store->first = first;
+    string_finalize(&line);
+}
+
+static FILE *kpd_redirect_stdout(void)
+{
+    //The document takes over standard output, everything else is printed to standard error
+    if (fflush(stdout) != 0) kpd_error(ERR_DUP, "fflush() failed");
+    const int document = dup(STDOUT_FILENO);
+    if (document < 0) kpd_error(ERR_DUP, "dup() failed");
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) kpd_error(ERR_DUP, "dup2() failed");
+    FILE *file = fdopen(document, "w");
+    if (file == NULL) kpd_error(ERR_DUP, "fdopen() failed");
+    return file;
+}
+
+//Needed by kpd_write_target and kpd_write_raw
+static void kpd_rewrite(FILE *file, size_t begin, const struct CharBuffer *current, const char *image, size_t image_size)
+{
+    size_t prefix = 0;
+    while (prefix < current->size && prefix < image_size && current->p[prefix] == image[prefix]) prefix++;
+
+    //Rewrite changed bytes in place, file keeps its inode and mode, identical file is not touched
+    if (prefix < current->size || prefix < image_size)
+    {
+        if (fseek(file, (long)(begin + prefix), SEEK_SET) < 0) kpd_error(ERR_SEEK, "fseek() failed");
+        fwrite(image + prefix, 1, image_size - prefix, file);
+        fflush(file);
+        if (image_size < current->size && ftruncate(fileno(file), (off_t)(begin + image_size)) < 0)
+            kpd_error(ERR_TRUNCATE, "ftruncate() failed");
+    }
 }
 
 //Needed by kpd_print_entry
@@ -98,6 +239,82 @@ static unsigned int get_marker_length(bool done, enum Priority priority)
     return done ? strlen("(done)") : marker_lengths[priority];
 }
 
+//Needed by kpd_format_entries
+static void kpd_format_json_string(const char *string)
+{
+    //Copies runs of plain bytes at once, escapes the rest
+    putchar('"');
+    const char *run = string;
+    for (const char *c = string; true; c++)
+    {
+        const unsigned char u = (unsigned char)*c;
+        if (u >= 0x20 && u != '"' && u != '\\') continue;
+        fwrite(run, 1, (size_t)(c - run), stdout);
+        if (u == '\0') break;
+        if (u == '"') fputs("\\\"", stdout);
+        else if (u == '\\') fputs("\\\\", stdout);
+        else if (u == '\n') fputs("\\n", stdout);
+        else if (u == '\r') fputs("\\r", stdout);
+        else if (u == '\t') fputs("\\t", stdout);
+        else printf("\\u%04x", (unsigned int)u);
+        run = c + 1;
+    }
+    putchar('"');
+}
+
+static void kpd_format_tsv_string(const char *string)
+{
+    //Copies runs of plain bytes at once, escapes separators
+    const char *run = string;
+    for (const char *c = string; true; c++)
+    {
+        const char u = *c;
+        if (u != '\0' && u != '\t' && u != '\n' && u != '\r' && u != '\\') continue;
+        fwrite(run, 1, (size_t)(c - run), stdout);
+        if (u == '\0') break;
+        if (u == '\t') fputs("\\t", stdout);
+        else if (u == '\n') fputs("\\n", stdout);
+        else if (u == '\r') fputs("\\r", stdout);
+        else fputs("\\\\", stdout);
+        run = c + 1;
+    }
+}
+
+static void kpd_format_entry(const struct Entry *entry, enum Format format)
+{
+    const char *booleans[2] = { "false", "true" };
+    if (format == FMT_TSV)
+    {
+        printf("%s%u\t%s\t%s\t%s\t",
+            entry->archived ? "A" : "",
+            (unsigned int)(entry->number + 1),
+            booleans[entry->done],
+            kpd_priority_strings[entry->priority],
+            booleans[entry->priority_explicit]);
+        kpd_format_tsv_string(entry->description);
+        char date[11] = "";
+        if (entry->due != 0) due_format(date, entry->due);
+        printf("\t%s\n", date);
+    }
+    else
+    {
+        printf("{\"number\":%u,\"done\":%s,\"archived\":%s,\"priority\":\"%s\",\"priority_explicit\":%s,\"description\":",
+            (unsigned int)(entry->number + 1),
+            booleans[entry->done],
+            booleans[entry->archived],
+            kpd_priority_strings[entry->priority],
+            booleans[entry->priority_explicit]);
+        kpd_format_json_string(entry->description);
+        char date[11];
+        if (entry->due != 0)
+        {
+            due_format(date, entry->due);
+            printf(",\"due\":\"%s\"}", date);
+        }
+        else fputs(",\"due\":null}", stdout);
+    }
+}
+
 //Needed by kpd_parse_number
 static bool kpd_parse_number_post_number(const char **current_string)
 {
@@ -186,85 +403,553 @@ void kpd_error(enum Error error, const char *format, ...)
     exit((int)error);
 }
 
+bool kpd_read_line(struct Entry *entry, struct CharBuffer *line)
+{
+    //Parse beginning, other lines are not tasks
+    if (line->size < 7
+    || line->p[0] != ' '
+    || line->p[1] != '-'
+    || line->p[2] != ' '
+    || line->p[3] != '['
+    || (line->p[4] != ' ' && line->p[4] != 'X')
+    || line->p[5] != ']'
+    || line->p[6] != ' ') return false;
+    entry->done = line->p[4] == 'X';
+    
+    //Parse priority
+    entry->priority = PRI_MEDIUM;
+    entry->priority_explicit = false;
+    const char *markers[4] = { "(priority: low)", "(priority: medium)", "(priority: high)", "(priority: critical)" };
+    for (enum Priority priority = 0; priority < 4; priority++)
+    {
+        char *marker_found = strstr(line->p, markers[priority]);
+        if (marker_found != NULL)
+        {
+            //Remove marker
+            entry->priority = priority;
+            entry->priority_explicit = true;
+            string_substitute(line, (size_t)(marker_found - line->p), strlen(markers[priority]), "", 0);
+            break;
+        }
+    }
+
+    //Parse due date, invalid markers stay in description
+    entry->due = 0;
+    char *due_found = strstr(line->p, DUE_MARKER);
+    if (due_found != NULL)
+    {
+        const size_t date_offset = (size_t)(due_found - line->p) + strlen(DUE_MARKER);
+        if (line->size >= date_offset + 11 && line->p[date_offset + 10] == ')')
+        {
+            entry->due = due_parse(line->p + date_offset);
+            if (entry->due != 0) string_substitute(line, (size_t)(due_found - line->p), strlen(DUE_MARKER) + 11, "", 0);
+        }
+    }
+
+    //Description stays in line, callers copy it
+    string_trim(line, 7, 0); //Not really efficient
+    entry->description = line->p;
+    return true;
+}
+
+void kpd_set_source(enum Source source, const struct EntryBuffer *entries)
+{
+    kpd_source = source;
+    kpd_source_entries = entries;
+}
+
+enum Source kpd_get_source(void)
+{
+    return kpd_source;
+}
+
+void kpd_set_section(const char *section)
+{
+    kpd_section = section;
+}
+
+const char *kpd_get_section(void)
+{
+    return kpd_section;
+}
+
+void kpd_find_target(struct CharBuffer *path)
+{
+    FILE *file = kpd_open_target(path);
+    fclose(file);
+}
+
 void kpd_read_target(void *file, struct EntryBuffer *entries, struct CharBuffer *path)
 {
+    //Entries held in memory
+    if (kpd_source == SRC_MEMORY)
+    {
+        if (file != NULL || path != NULL) kpd_error(ERR_USAGE, TARGET " is read-only here");
+        if (entries == NULL) return;
+        string_substitute(&entries->opaque, 0, entries->opaque.size, kpd_source_entries->opaque.p, kpd_source_entries->opaque.size);
+        entries_set_size(entries, kpd_source_entries->size);
+        for (size_t i = 0; i < entries->size; i++)
+        {
+            struct CharBuffer description = { 0 };
+            string_set_size(&description, 0);
+            string_substitute(&description, 0, 0, kpd_source_entries->p[i].description, strlen(kpd_source_entries->p[i].description));
+            entries->p[i] = kpd_source_entries->p[i];
+            entries->p[i].description = description.p;
+        }
+        return;
+    }
+
     //Search for TODO.md
-    size_t step = 0;
-    struct CharBuffer local_path = { 0 };
-    string_set_cwd(&local_path);
-    string_append_file(&local_path);
     FILE *local_file = NULL;
-    while (true)
+    if (kpd_source == SRC_STDIN)
     {
-        local_file = fopen(local_path.p, "r+");
-        if (local_file != NULL) break;
-        if (!string_remove_file(&local_path) || !string_remove_file(&local_path))
-            kpd_error(ERR_USAGE, "current_string directory does not contain " TARGET);
-        string_append_file(&local_path);
-        step++;
+        if (path != NULL) kpd_error(ERR_USAGE, "git is not available when reading standard input");
+        local_file = stdin;
+    }
+    else
+    {
+        local_file = kpd_open_target(path);
     }
 
     //Parse TODO.md
+    kpd_parse_target(local_file, entries, NULL);
+
+    //Cleanup
+    if (kpd_source == SRC_STDIN)
+    {
+        if (file != NULL) *((FILE**)file) = kpd_redirect_stdout();
+    }
+    else
+    {
+        if (file == NULL) fclose(local_file);
+        else *((FILE**)file) = local_file;
+    }
+}
+
+void kpd_read_store(struct EntryStore *store)
+{
+    //Entries held in memory
+    if (kpd_source == SRC_MEMORY)
+    {
+        for (const struct Entry *entry = kpd_source_entries->p; entry < kpd_source_entries->p + kpd_source_entries->size; entry++)
+            store_push(store, entry);
+        return;
+    }
+
+    //Parse TODO.md
+    FILE *file = (kpd_source == SRC_STDIN) ? stdin : kpd_open_target(NULL);
+    kpd_parse_target(file, NULL, store);
+
+    //Cleanup
+    if (file != stdin) fclose(file);
+}
+
+void kpd_read_counts(size_t counts[2][4])
+{
+    memset(counts, 0, 2 * sizeof(*counts));
+
+    //Sections need parsing of headings, count parsed entries
+    if (kpd_source == SRC_MEMORY || kpd_section != NULL)
+    {
+        struct EntryStore store = { 0 };
+        kpd_read_store(&store);
+        for (size_t i = 0; i < store.size; i++) counts[(store.flags[i] & FLAG_DONE) != 0][store.flags[i] & FLAG_PRIORITY]++;
+        store_finalize(&store);
+        return;
+    }
+
+    //Scan raw TODO.md
+    FILE *file = (kpd_source == SRC_STDIN) ? stdin : kpd_open_target(NULL);
+    struct CharBuffer content = { 0 };
+    string_append_stream(&content, file);
+    count_scan(counts, content.p, content.size);
+
+    //Cleanup
+    free(content.p);
+    if (file != stdin) fclose(file);
+}
+
+void kpd_read_raw(void *file, struct CharBuffer *content, struct CharBuffer *path)
+{
+    //Whole TODO.md as it is, sections are not parsed
+    if (kpd_source == SRC_MEMORY) kpd_error(ERR_USAGE, TARGET " is read-only here");
+    if (kpd_source == SRC_STDIN && path != NULL) kpd_error(ERR_USAGE, "git is not available when reading standard input");
+    FILE *local_file = (kpd_source == SRC_STDIN) ? stdin : kpd_open_target(path);
+    string_append_stream(content, local_file);
+
+    //Cleanup
+    if (kpd_source == SRC_STDIN)
+    {
+        if (file != NULL) *((FILE**)file) = kpd_redirect_stdout();
+    }
+    else
+    {
+        if (file == NULL) fclose(local_file);
+        else *((FILE**)file) = local_file;
+    }
+}
+
+void kpd_archive_path(struct CharBuffer *path)
+{
+    string_substitute(path, path->size - strlen(TARGET), strlen(TARGET), ARCHIVE, strlen(ARCHIVE));
+}
+
+void kpd_read_archive(struct EntryStore *store)
+{
+    //Archive belongs to whole TODO.md
+    if (kpd_source != SRC_FILE || kpd_section != NULL) return;
+
+    //Parse TODO.archive.md if exists
+    struct CharBuffer path = { 0 };
+    kpd_find_target(&path);
+    kpd_archive_path(&path);
+    FILE *file = fopen(path.p, "r");
+    free(path.p);
+    if (file == NULL) return;
+    store->archived = store->size;
+    kpd_parse_target(file, NULL, store);
+    for (size_t i = store->archived; i < store->size; i++) store->flags[i] |= FLAG_ARCHIVED;
+
+    //Cleanup
+    fclose(file);
+}
+
+//Needed by kpd_read_page
+static void kpd_read_page_store(struct EntryBuffer *entries, struct EntryStore *store, const struct Query *query, bool sorted, size_t offset, size_t limit)
+{
+    //Select, sorted pages skip blocked entries like kpd sort
+    size_t *order = malloc((store->size + 1) * sizeof(*order));
+    char *mask = malloc(store->size + 1);
+    if (order == NULL || mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    if (sorted) store_sort(order, store);
+    else for (size_t i = 0; i < store->size; i++) order[i] = i;
+    query_select_store(mask, query, store);
+    if (sorted)
+    {
+        struct Graph graph;
+        graph_build_store(&graph, store);
+        graph_unblocked(mask, &graph);
+        graph_finalize(&graph);
+    }
+
+    //Copy page
+    for (size_t k = 0; k < store->size && entries->size < limit; k++)
+    {
+        const size_t i = order[k];
+        if (!mask[i]) continue;
+        if (offset > 0) { offset--; continue; }
+        struct Entry entry = { 0 };
+        entry.archived = (store->flags[i] & FLAG_ARCHIVED) != 0;
+        entry.number = entry.archived ? (i - store->archived) : i;
+        entry.priority = (enum Priority)(store->flags[i] & FLAG_PRIORITY);
+        entry.priority_explicit = (store->flags[i] & FLAG_EXPLICIT) != 0;
+        entry.done = (store->flags[i] & FLAG_DONE) != 0;
+        entry.due = store->dues[i];
+        char *description = strdup(store->blob.p + store->offsets[i]);
+        if (description == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+        entries_set_size(entries, entries->size + 1);
+        entries->p[entries->size - 1] = entry;
+        entries->p[entries->size - 1].description = description;
+    }
+
+    //Cleanup
+    free(order);
+    free(mask);
+    store_finalize(store);
+}
+
+void kpd_read_page(struct EntryBuffer *entries, const struct Query *query, bool sorted, size_t offset, size_t limit)
+{
+    const bool done_requested = (query->flags & QUERY_DONE) != 0;
+
+    //Sections are only known to kpd_parse_target, sorted positions are only known for flag tests, page whole store
+    if (kpd_source == SRC_MEMORY || kpd_section != NULL || (sorted && query->text))
+    {
+        struct EntryStore store = { 0 };
+        kpd_read_store(&store);
+        if (done_requested) kpd_read_archive(&store);
+        kpd_read_page_store(entries, &store, query, sorted, offset, limit);
+        return;
+    }
+
+    //Raw TODO.md, followed by archive if done entries are requested
+    FILE *file = (kpd_source == SRC_STDIN) ? stdin : kpd_open_target(NULL);
+    struct CharBuffer content = { 0 };
+    string_append_stream(&content, file);
+    if (file != stdin) fclose(file);
+    const size_t archive_offset = content.size;
+    if (done_requested && kpd_source == SRC_FILE)
+    {
+        struct CharBuffer path = { 0 };
+        kpd_find_target(&path);
+        kpd_archive_path(&path);
+        FILE *archive = fopen(path.p, "r");
+        free(path.p);
+        if (archive != NULL)
+        {
+            if (content.size > 0 && content.p[content.size - 1] != '\n') string_substitute(&content, content.size, 0, "\n", 1);
+            string_append_stream(&content, archive);
+            fclose(archive);
+        }
+    }
+    const char *end = content.p + content.size;
+
+    //Blocked entries are only known from whole graph, parse and page whole store
+    if (sorted && content.size > 0 && strstr(content.p, GRAPH_MARKER) != NULL)
+    {
+        struct EntryStore store = { 0 };
+        FILE *memory = fmemopen(content.p, content.size, "r");
+        if (memory == NULL) kpd_error(ERR_MALLOC, "fmemopen() failed");
+        kpd_parse_target(memory, NULL, &store);
+        fclose(memory);
+        free(content.p);
+        kpd_read_page_store(entries, &store, query, sorted, offset, limit);
+        return;
+    }
+
+    //Positions of sorted groups in page, groups are ordered like in store_sort
+    size_t positions[8] = { 0 };
+    size_t page_size = limit;
+    if (sorted)
+    {
+        size_t counts[2][4] = { { 0 } };
+        count_scan(counts, content.p, content.size);
+        size_t position = 0;
+        for (size_t key = 0; key < 8; key++)
+        {
+            const unsigned int done = (key < 4) ? 0 : 1;
+            const unsigned int priority = (key < 4) ? (3 - (unsigned int)key) : (7 - (unsigned int)key);
+            positions[key] = position;
+            if ((query->flags >> (done * 4 + priority)) & 1u) position += counts[done][priority];
+        }
+        if (position < offset) page_size = 0;
+        else if (position - offset < page_size) page_size = position - offset;
+        entries_set_size(entries, page_size);
+    }
+
+    //Parse entries of page only, descriptions only if query tests them
     struct CharBuffer line = { 0 };
-    string_set_size(&line, INITIAL_BUFFER_SIZE);
     size_t number = 0;
-    while (string_set_line(&line, local_file))
+    size_t archive_number = SIZE_MAX;
+    size_t filled = 0;
+    const char *task;
+    unsigned char flags;
+    for (const char *p = content.p; filled < page_size && (p = count_task(&flags, &task, p, end)) != NULL; number++)
     {
-        
+        //Archived tasks are numbered on their own
+        const bool archived = (size_t)(task - content.p) >= archive_offset;
+        if (archived && archive_number == SIZE_MAX) archive_number = number;
+        if (((query->flags >> (((flags & FLAG_DONE) ? 4u : 0u) | (flags & FLAG_PRIORITY))) & 1u) == 0) continue;
         struct Entry entry = { 0 };
-        entry.number = number;
-        if (!kpd_read_line(&entry, &line)) continue;
-        if (entries == NULL)
+        if (query->text)
         {
-            free(entry.description);
+            string_set_size(&line, (size_t)(p - task));
+            memcpy(line.p, task, line.size);
+            kpd_read_line(&entry, &line);
+            if (!query_match(query, flags, entry.description)) continue;
+        }
+        size_t index;
+        if (sorted)
+        {
+            const size_t priority = flags & FLAG_PRIORITY;
+            const size_t key = (flags & FLAG_DONE) ? (7 - priority) : (3 - priority);
+            const size_t position = positions[key]++;
+            if (position < offset || position - offset >= page_size) continue;
+            index = position - offset;
         }
         else
         {
-            entries_set_size(entries, number + 1);
-            entries->p[number] = entry;
+            if (offset > 0) { offset--; continue; }
+            index = entries->size;
+            entries_set_size(entries, index + 1);
         }
-        number++;
+        if (!query->text)
+        {
+            string_set_size(&line, (size_t)(p - task));
+            memcpy(line.p, task, line.size);
+            kpd_read_line(&entry, &line);
+        }
+        entry.archived = archived;
+        entry.number = archived ? (number - archive_number) : number;
+        entry.description = strdup(entry.description);
+        if (entry.description == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+        entries->p[index] = entry;
+        filled++;
     }
 
-    //Make relative path
-    if (path != NULL)
+    //Cleanup
+    free(line.p);
+    free(content.p);
+}
+
+bool kpd_read_path(struct EntryBuffer *entries, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return false;
+    const char *section = kpd_section;
+    kpd_section = NULL;
+    kpd_parse_target(file, entries, NULL);
+    kpd_section = section;
+    fclose(file);
+    return true;
+}
+
+void kpd_write_entry(void *file, const struct Entry *entry)
+{
+    const char *markers[4] = { " (priority: low)", " (priority: medium)", " (priority: high)", " (priority: critical)" };
+    const char *marker = entry->priority_explicit ? markers[entry->priority] : "";
+    char date[11];
+    if (entry->due != 0)
     {
-        string_set_size(&local_path, 0);
-        if (step == 0)
+        due_format(date, entry->due);
+        fprintf(file, " - [%c] %s%s " DUE_MARKER "%s)\n", entry->done ? 'X' : ' ', entry->description, marker, date);
+    }
+    else fprintf(file, " - [%c] %s%s\n", entry->done ? 'X' : ' ', entry->description, marker);
+}
+
+//Needed by kpd_read_whole and kpd_write_target
+static void kpd_write_image(struct CharBuffer *image, const struct EntryBuffer *entries)
+{
+    //Serialize entries between blocks of other lines
+    FILE *image_file = open_memstream(&image->p, &image->size);
+    if (image_file == NULL) kpd_error(ERR_MALLOC, "open_memstream() failed");
+    size_t opaque_written = 0;
+    for (struct Entry *entry = entries->p; entry < entries->p + entries->size; entry++)
+    {
+        if (entry->offset > opaque_written)
         {
-            string_substitute(&local_path, 0, 0, TARGET, strlen(TARGET));
+            fwrite(entries->opaque.p + opaque_written, 1, entry->offset - opaque_written, image_file);
+            opaque_written = entry->offset;
         }
-        else
+        kpd_write_entry(image_file, entry);
+    }
+    if (entries->opaque.size > opaque_written) fwrite(entries->opaque.p + opaque_written, 1, entries->opaque.size - opaque_written, image_file);
+    if (fclose(image_file) != 0) kpd_error(ERR_MALLOC, "open_memstream() failed");
+    image->capacity = image->size + 1;
+}
+
+void kpd_read_whole(void *file, struct EntryBuffer *entries, char **mask)
+{
+    //Only sections see part of TODO.md
+    if (kpd_section == NULL) return;
+
+    //Whole TODO.md as on disk, or lines before section, section and rest of standard input
+    struct CharBuffer content = { 0 };
+    if (kpd_source == SRC_STDIN)
+    {
+        struct CharBuffer image = { 0 };
+        kpd_write_image(&image, entries);
+        string_set_size(&content, 0);
+        if (kpd_section_before.size > 0) string_substitute(&content, content.size, 0, kpd_section_before.p, kpd_section_before.size);
+        string_substitute(&content, content.size, 0, image.p, image.size);
+        if (kpd_section_after.size > 0) string_substitute(&content, content.size, 0, kpd_section_after.p, kpd_section_after.size);
+        string_append_stream(&content, stdin);
+        free(image.p);
+    }
+    else
+    {
+        if (fseek(file, 0, SEEK_SET) < 0) kpd_error(ERR_SEEK, "fseek() failed");
+        string_append_stream(&content, file);
+    }
+
+    //Parse whole TODO.md, from now on it is written whole
+    struct EntryBuffer whole = { 0 };
+    FILE *stream = fmemopen(content.p, content.size, "r");
+    if (stream == NULL) kpd_error(ERR_MALLOC, "fmemopen() failed");
+    kpd_section = NULL;
+    kpd_parse_target(stream, &whole, NULL);
+    kpd_section_begin = 0;
+    fclose(stream);
+    free(content.p);
+    if (entries->first + entries->size > whole.size) kpd_error(ERR_FORMAT, TARGET " changed while reading it");
+
+    //Entries of section replace their parsed copies, they may be modified already
+    char *whole_mask = calloc(whole.size + 1, 1);
+    if (whole_mask == NULL) kpd_error(ERR_MALLOC, "calloc() failed");
+    for (size_t i = 0; i < entries->size; i++)
+    {
+        struct Entry *entry = &whole.p[entries->first + i];
+        const size_t number = entry->number;
+        const size_t offset = entry->offset;
+        free(entry->description);
+        *entry = entries->p[i];
+        entry->number = number;
+        entry->offset = offset;
+        whole_mask[entries->first + i] = (*mask)[i];
+    }
+    free(entries->opaque.p);
+    free(entries->p);
+    *entries = whole;
+    free(*mask);
+    *mask = whole_mask;
+}
+
+void kpd_write_target(void *file, const struct EntryBuffer *entries)
+{
+    //Serialize entries
+    struct CharBuffer image = { 0 };
+    kpd_write_image(&image, entries);
+
+    //Standard output always gets whole TODO.md
+    if (kpd_source != SRC_FILE)
+    {
+        struct CharBuffer after = { 0 };
+        if (kpd_section != NULL)
         {
-            for (size_t i = 0; i < step; i++) string_substitute(&local_path, local_path.size, 0, "../", 3);
-            string_append_file(&local_path);
+            fwrite(kpd_section_before.p, 1, kpd_section_before.size, file);
+            string_substitute(&after, 0, 0, kpd_section_after.p, kpd_section_after.size);
+            string_append_stream(&after, stdin);
         }
+        fwrite(image.p, 1, image.size, file);
+        if (after.p != NULL) fwrite(after.p, 1, after.size, file);
+        free(after.p);
+        free(image.p);
+        return;
+    }
+
+    //Compare with current contents, lines after section are kept
+    struct CharBuffer current = { 0 };
+    if (fseek(file, (long)kpd_section_begin, SEEK_SET) < 0) kpd_error(ERR_SEEK, "fseek() failed");
+    string_append_stream(&current, file);
+    if (kpd_section != NULL)
+    {
+        const size_t after_begin = kpd_section_end - kpd_section_begin;
+        string_substitute(&image, image.size, 0, current.p + after_begin, current.size - after_begin);
     }
+    kpd_rewrite(file, kpd_section_begin, &current, image.p, image.size);
 
     //Cleanup
-    string_finalize(&line);
-    if (file == NULL) fclose(local_file);
-    else *((FILE**)file) = local_file;
-    if (path == NULL) string_finalize(&local_path);
-    else *path = local_path;
+    free(current.p);
+    free(image.p);
 }
 
-void kpd_write_target(void *file, const struct EntryBuffer *entries)
+void kpd_write_raw(void *file, const struct CharBuffer *current, const char *p, size_t size)
 {
-    const int seek_result = fseek(file, 0, SEEK_SET);
-    if (seek_result < 0) kpd_error(ERR_SEEK, "fseek() failed");
+    //Standard output always gets whole TODO.md
+    if (kpd_source != SRC_FILE)
+    {
+        fwrite(p, 1, size, file);
+        return;
+    }
+    kpd_rewrite(file, 0, current, p, size);
+}
 
-    for (struct Entry *entry = entries->p; entry < entries->p + entries->size; entry++)
+void kpd_write_archive(const char *path, const struct EntryBuffer *entries, const char *mask)
+{
+    //Append only, archive is never rewritten
+    struct CharBuffer archive_path = { 0 };
+    string_substitute(&archive_path, 0, 0, path, strlen(path));
+    kpd_archive_path(&archive_path);
+    FILE *file = fopen(archive_path.p, "a");
+    if (file == NULL) kpd_error(ERR_PATH, "could not open '%s'", archive_path.p);
+    for (size_t i = 0; i < entries->size; i++)
     {
-        const char *markers[4] = { " (priority: low)", " (priority: medium)", " (priority: high)", " (priority: critical)" };
-        const char *marker = entry->priority_explicit ? markers[entry->priority] : "";
-        fprintf(file, " - [%c] %s%s\n", entry->done ? 'X' : ' ', entry->description, marker);
+        if (mask[i]) kpd_write_entry(file, &entries->p[i]);
     }
 
-    const long tell_result = ftell(file);
-    if (tell_result < 0) kpd_error(ERR_TELL, "ftell() failed");
-    const int truncate_result = ftruncate(fileno(file), tell_result);
-    if (truncate_result < 0) kpd_error(ERR_TRUNCATE, "ftell() failed");
+    //Cleanup
+    if (fclose(file) != 0) kpd_error(ERR_PATH, "could not write '%s'", archive_path.p);
+    free(archive_path.p);
 }
 
 void kpd_print_entry(const struct Entry *entry, unsigned int max_length, unsigned int max_marker_length)
@@ -278,7 +963,7 @@ void kpd_print_entry(const struct Entry *entry, unsigned int max_length, unsigne
     };
 
     const size_t number = entry->number + 1;
-    const unsigned int number_length = get_number_length(number);
+    const unsigned int number_length = get_number_length(number) + (entry->archived ? 1 : 0);
     const unsigned int number_spaces = (max_length == 0) ? 0 : (max_length - number_length);
 
     const char *marker = entry->done ? GREEN "(done)" DEFAULT : markers[entry->priority];
@@ -287,18 +972,22 @@ void kpd_print_entry(const struct Entry *entry, unsigned int max_length, unsigne
     const unsigned int left_marker_spaces = (marker_spaces) / 2;
     const unsigned int right_marker_spaces = (marker_spaces + 1) / 2;
 
-    printf("%u.%*s %*s%s%*s %s\n",
+    char date[11] = "";
+    if (entry->due != 0) due_format(date, entry->due);
+    printf("%s%u.%*s %*s%s%*s %s%s%s%s\n",
+        entry->archived ? "A" : "",
         (unsigned int)number,
         number_spaces, "",
         left_marker_spaces, "", marker, right_marker_spaces, "",
-        entry->description);
+        entry->description,
+        (entry->due != 0) ? " " MAGENTA DUE_MARKER : "", date, (entry->due != 0) ? ")" DEFAULT : "");
 }
 
 void kpd_print_entries(const struct EntryBuffer *entries, const char *mask)
 {
     const bool mask_valid = mask != NULL;
 
-    size_t max_number = 0; //Could optimize for sorted arrays, doesn't improve Big O though
+    unsigned int max_length = 0; //Could optimize for sorted arrays, doesn't improve Big O though
     unsigned int max_marker_length = 0;
     const char *mask_i = mask;
     for (const struct Entry *entry = entries->p; entry < entries->p + entries->size; entry++)
@@ -307,12 +996,12 @@ void kpd_print_entries(const struct EntryBuffer *entries, const char *mask)
         if (print)
         {
             const unsigned int marker_length = get_marker_length(entry->done, entry->priority);
-            if (entry->number > max_number) max_number = entry->number;
+            const unsigned int length = get_number_length(entry->number + 1) + (entry->archived ? 1 : 0);
+            if (length > max_length) max_length = length;
             if (marker_length > max_marker_length) max_marker_length = marker_length;
         }
         if (mask_valid) mask_i++;
     }
-    const unsigned int max_length = get_number_length(max_number + 1);
 
     mask_i = mask;
     for (const struct Entry *entry = entries->p; entry < entries->p + entries->size; entry++)
@@ -323,13 +1012,92 @@ void kpd_print_entries(const struct EntryBuffer *entries, const char *mask)
     }
 }
 
-bool kpd_parse_number(char *mask, size_t mask_size, const char *number_string)
+void kpd_format_entries(const struct EntryBuffer *entries, const char *mask, enum Format format)
+{
+    if (format == FMT_TEXT)
+    {
+        kpd_print_entries(entries, mask);
+        return;
+    }
+
+    //Stream entries without intermediate strings
+    if (format == FMT_JSON) putchar('[');
+    else if (format == FMT_TSV) printf("number\tdone\tpriority\tpriority_explicit\tdescription\tdue\n");
+    bool first = true;
+    const char *mask_i = mask;
+    for (const struct Entry *entry = entries->p; entry < entries->p + entries->size; entry++)
+    {
+        const bool print = (mask == NULL || *mask_i != '\0');
+        if (mask != NULL) mask_i++;
+        if (!print) continue;
+        if (format == FMT_JSON) fputs(first ? "\n" : ",\n", stdout);
+        kpd_format_entry(entry, format);
+        if (format == FMT_NDJSON) putchar('\n');
+        first = false;
+    }
+    if (format == FMT_JSON) fputs(first ? "]\n" : "\n]\n", stdout);
+}
+
+bool kpd_parse_option(int *argc, char **argv, const char *option, const char **value)
+{
+    for (int i = 0; i < *argc; i++)
+    {
+        if (strcmp(argv[i], option) != 0) continue;
+        const int option_size = (value == NULL) ? 1 : 2;
+        if (i + option_size > *argc) kpd_error(ERR_USAGE, "'%s' requires a value", option);
+        if (value != NULL) *value = argv[i + 1];
+        memmove(&argv[i], &argv[i + option_size], (size_t)(*argc - i - option_size) * sizeof(*argv));
+        *argc -= option_size;
+        return true;
+    }
+    return false;
+}
+
+enum Format kpd_parse_format(int *argc, char **argv)
+{
+    enum Format format = FMT_TEXT;
+    const char *format_string;
+    if (kpd_parse_option(argc, argv, "--format", &format_string) && !kpd_resolve_format(&format, format_string))
+        kpd_error(ERR_USAGE, "'%s' is not a valid format", format_string);
+    return format;
+}
+
+bool kpd_parse_size(int *argc, char **argv, const char *option, size_t *value)
 {
+    const char *value_string;
+    if (!kpd_parse_option(argc, argv, option, &value_string)) return false;
+    if (value_string[0] == '\0' || value_string[strspn(value_string, "0123456789")] != '\0')
+        kpd_error(ERR_USAGE, "'%s' is not a valid value of '%s'", value_string, option);
+    *value = (size_t)strtoull(value_string, NULL, 10);
+    return true;
+}
+
+bool kpd_parse_number(char *mask, const struct EntryBuffer *entries, const char *number_string)
+{
+    const size_t mask_size = (entries != NULL) ? entries->size : 0;
     if (mask != NULL) memset(mask, 0, mask_size);
 
+    struct IdIndex index = { 0 };
     const char *current_string = number_string;
     while (*current_string != '\0')
     {
+        //Try to read ID
+        if (*current_string == '@')
+        {
+            const char *id = current_string + 1;
+            const size_t id_length = strspn(id, "0123456789abcdef");
+            if (id_length < 4 || id_length > 16) return false;
+            current_string = id + id_length;
+            if (mask != NULL)
+            {
+                //Index once for all IDs
+                if (index.hashes == NULL) id_index(&index, entries);
+                if (!id_find(mask, &index, id, id_length)) kpd_error(ERR_USAGE, "'@%.*s' does not match any task", (int)id_length, id);
+            }
+            if (!kpd_parse_number_post_number(&current_string)) return false;
+            continue;
+        }
+
         //Try to read number
         char *next_string;
         size_t begin = strtoul(current_string, &next_string, 10);
@@ -364,23 +1132,33 @@ bool kpd_parse_number(char *mask, size_t mask_size, const char *number_string)
             return false;
         }
     }
+    id_finalize(&index);
     return true;
 }
 
-char *kpd_create_mask(size_t mask_size, const char *number_string)
+char *kpd_create_mask(const struct EntryBuffer *entries, const char *number_string)
 {
-    char *mask = malloc(mask_size);
+    char *mask = malloc(entries->size + 1);
     if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
-    kpd_parse_number(mask, mask_size, number_string);
+    kpd_parse_number(mask, entries, number_string);
     return mask;
 }
 
+void kpd_set_query(const struct Query *query)
+{
+    kpd_query = query;
+}
+
 char *kpd_create_mask_highest_open(const struct EntryBuffer *entries)
 {
+    if (kpd_query != NULL) return kpd_create_mask_query(entries);
     char *mask = malloc(entries->size);
     if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    struct Graph graph;
+    graph_build(&graph, entries);
     size_t highest;
-    if (!entries_highest_open(&highest, entries)) kpd_error(ERR_USAGE, "no entries");
+    if (!graph_next(&highest, &graph)) kpd_error(ERR_USAGE, "no entries");
+    graph_finalize(&graph);
     memset(mask, '\0', entries->size);
     mask[highest] = '\1';
     return mask;
@@ -388,6 +1166,7 @@ char *kpd_create_mask_highest_open(const struct EntryBuffer *entries)
 
 char *kpd_create_mask_last_closed(const struct EntryBuffer *entries)
 {
+    if (kpd_query != NULL) return kpd_create_mask_query(entries);
     char *mask = malloc(entries->size);
     if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
     const struct Entry *last = NULL;
@@ -408,8 +1187,7 @@ char *kpd_create_mask_last_closed(const struct EntryBuffer *entries)
 bool kpd_resolve_action(enum Action *action, const char *action_string)
 {
     size_t action_index;
-    const char *action_strings[] = { "commit", "remove", "done", "undo", "priority", "edit" };
-    const bool result = string_resolve(&action_index, action_string, action_strings, sizeof(action_strings)/sizeof(*action_strings));
+    const bool result = string_resolve(&action_index, action_string, kpd_action_strings, sizeof(kpd_action_strings)/sizeof(*kpd_action_strings));
     if (result) *action = (enum Action)action_index;
     return result;
 }
@@ -417,8 +1195,7 @@ bool kpd_resolve_action(enum Action *action, const char *action_string)
 bool kpd_resolve_status(enum Status *status, const char *status_string)
 {
     size_t status_index;
-    const char *status_strings[] = { "all", "open", "done" };
-    const bool result = string_resolve(&status_index, status_string, status_strings, sizeof(status_strings)/sizeof(*status_strings));
+    const bool result = string_resolve(&status_index, status_string, kpd_status_strings, sizeof(kpd_status_strings)/sizeof(*kpd_status_strings));
     if (result) *status = (enum Status)status_index;
     return result;
 }
@@ -426,12 +1203,27 @@ bool kpd_resolve_status(enum Status *status, const char *status_string)
 bool kpd_resolve_priority(enum Priority *priority, const char *priority_string)
 {
     size_t priority_index;
-    const char *priority_strings[] = { "low", "medium", "high", "critical" };
-    const bool result = string_resolve(&priority_index, priority_string, priority_strings, sizeof(priority_strings)/sizeof(*priority_strings));
+    const bool result = string_resolve(&priority_index, priority_string, kpd_priority_strings, sizeof(kpd_priority_strings)/sizeof(*kpd_priority_strings));
     if (result) *priority = (enum Priority)priority_index;
     return result;
 }
 
+bool kpd_resolve_format(enum Format *format, const char *format_string)
+{
+    size_t format_index;
+    const bool result = string_resolve(&format_index, format_string, kpd_format_strings, sizeof(kpd_format_strings)/sizeof(*kpd_format_strings));
+    if (result && format != NULL) *format = (enum Format)format_index;
+    return result;
+}
+
+bool kpd_resolve_input(enum Input *input, const char *input_string)
+{
+    size_t input_index;
+    const bool result = string_resolve(&input_index, input_string, kpd_input_strings, sizeof(kpd_input_strings)/sizeof(*kpd_input_strings));
+    if (result) *input = (enum Input)input_index;
+    return result;
+}
+
 bool kpd_resolve_commit(const char *commit_string)
 {
     const size_t commit_length = strlen(commit_string);
@@ -439,9 +1231,9 @@ bool kpd_resolve_commit(const char *commit_string)
     return commit_length <= only_option_length && memcmp(commit_string, "commit", commit_length) == 0;
 }
 
-void kpd_invoke_git(const char *path, const char *commit_message)
+void kpd_invoke_git_add(const char *path)
 {
-    char *arguments[5];
+    char *arguments[4];
     arguments[0] = "git";
     arguments[1] = "add";
     arguments[2] = strdup(path);
@@ -449,7 +1241,13 @@ void kpd_invoke_git(const char *path, const char *commit_message)
     if (arguments[2] == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
     kpd_invoke(arguments);
     free(arguments[2]);
+}
+
+void kpd_invoke_git(const char *path, const char *commit_message)
+{
+    kpd_invoke_git_add(path);
 
+    char *arguments[5];
     arguments[0] = "git";
     arguments[1] = "commit";
     arguments[2] = "-m";
@@ -458,4 +1256,105 @@ void kpd_invoke_git(const char *path, const char *commit_message)
     if (arguments[3] == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
     kpd_invoke(arguments);
     free(arguments[3]);
-}
\ No newline at end of file
+}
+
+void *kpd_open_git(char *const *arguments, int *id)
+{
+    //Run git with stdout connected to pipe
+    int pipe_ends[2];
+    if (pipe(pipe_ends) < 0) kpd_error(ERR_PIPE, "pipe() failed");
+    fflush(stdout);
+    const pid_t child = fork();
+    if (child < 0)
+    {
+        kpd_error(ERR_FORK, "fork() failed");
+    }
+    else if (child == 0)
+    {
+        close(pipe_ends[0]);
+        if (dup2(pipe_ends[1], STDOUT_FILENO) < 0) kpd_error(ERR_DUP, "dup2() failed");
+        close(pipe_ends[1]);
+        if (execvp(arguments[0], arguments) < 0) kpd_error(ERR_EXEC, "execvp() failed");
+    }
+
+    //Read from other end
+    close(pipe_ends[1]);
+    FILE *file = fdopen(pipe_ends[0], "r");
+    if (file == NULL) kpd_error(ERR_PIPE, "fdopen() failed");
+    *id = child;
+    return file;
+}
+
+void *kpd_open_git_batch(char *const *arguments, void *input, int *id)
+{
+    //Run git with stdin and stdout connected to pipes
+    int input_ends[2];
+    int output_ends[2];
+    if (pipe(input_ends) < 0 || pipe(output_ends) < 0) kpd_error(ERR_PIPE, "pipe() failed");
+    fflush(stdout);
+    const pid_t child = fork();
+    if (child < 0)
+    {
+        kpd_error(ERR_FORK, "fork() failed");
+    }
+    else if (child == 0)
+    {
+        close(input_ends[1]);
+        close(output_ends[0]);
+        if (dup2(input_ends[0], STDIN_FILENO) < 0 || dup2(output_ends[1], STDOUT_FILENO) < 0) kpd_error(ERR_DUP, "dup2() failed");
+        close(input_ends[0]);
+        close(output_ends[1]);
+        if (execvp(arguments[0], arguments) < 0) kpd_error(ERR_EXEC, "execvp() failed");
+    }
+
+    //Write to one end, read from other
+    close(input_ends[0]);
+    close(output_ends[1]);
+    FILE *input_file = fdopen(input_ends[1], "w");
+    FILE *file = fdopen(output_ends[0], "r");
+    if (input_file == NULL || file == NULL) kpd_error(ERR_PIPE, "fdopen() failed");
+    *((FILE**)input) = input_file;
+    *id = child;
+    return file;
+}
+
+void kpd_close_git(void *file, int id)
+{
+    fclose(file);
+    int status;
+    if (waitpid(id, &status, 0) < 0) kpd_error(ERR_WAIT, "waitpid() failed");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) kpd_error(ERR_GIT, "'git' failed");
+}
+
+void kpd_read_times(long *times, size_t size, const char *path)
+{
+    //Each line is reported with time of commit that last changed it, uncommitted lines with current time
+    char *arguments[6] = { "git", "blame", "--line-porcelain", "--", NULL, NULL };
+    arguments[4] = strdup(path);
+    if (arguments[4] == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+    int id;
+    FILE *file = kpd_open_git(arguments, &id);
+
+    //Assign times to task lines
+    struct CharBuffer line = { 0 };
+    string_set_size(&line, INITIAL_BUFFER_SIZE);
+    const char *time_key = "committer-time ";
+    long time = 0;
+    size_t number = 0;
+    while (string_set_line(&line, file))
+    {
+        if (strncmp(line.p, time_key, strlen(time_key)) == 0) time = strtol(line.p + strlen(time_key), NULL, 10);
+        if (line.p[0] != '\t') continue;
+        struct Entry entry = { 0 };
+        string_substitute(&line, 0, 1, "", 0);
+        if (!kpd_read_line(&entry, &line)) continue;
+        if (number < size) times[number] = time;
+        number++;
+    }
+    kpd_close_git(file, id);
+    if (number != size) kpd_error(ERR_GIT, "'git blame' does not match " TARGET);
+
+    //Cleanup
+    free(line.p);
+    free(arguments[4]);
+}
@@ -0,0 +1,265 @@
+#include "kpd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COMPLETE_LIMIT 50 //Number candidates, more do not fit on screen anyway
+
+//Needed by complete_arguments and complete_run
+static void complete_keywords(const char *word, const char *const *keywords, size_t keywords_size)
+{
+    const size_t word_length = strlen(word);
+    for (size_t i = 0; i < keywords_size; i++)
+    {
+        if (strncmp(word, keywords[i], word_length) == 0) printf("%s\n", keywords[i]);
+    }
+}
+
+static void complete_ids(const char *word, size_t list_length, enum Status status)
+{
+    //IDs depend on all descriptions
+    const char *prefix = word + list_length + 1;
+    const size_t prefix_length = strlen(prefix);
+    struct EntryBuffer entries = { 0 };
+    kpd_read_target(NULL, &entries, NULL);
+    struct IdIndex index = { 0 };
+    id_index(&index, &entries);
+    size_t candidates = 0;
+    for (size_t i = 0; i < entries.size && candidates < COMPLETE_LIMIT; i++)
+    {
+        const struct Entry *entry = &entries.p[i];
+        if ((status == STA_OPEN && entry->done) || (status == STA_DONE && !entry->done)) continue;
+        char id[17];
+        id_format(id, &index, i);
+        if (strncmp(id, prefix, prefix_length) != 0) continue;
+        printf("%.*s@%s\t%s\n", (int)list_length, word, id, entry->description);
+        candidates++;
+    }
+
+    //Cleanup
+    id_finalize(&index);
+    entries_finalize(&entries, true);
+}
+
+static void complete_numbers(const char *word, enum Status status)
+{
+    //Complete last number of comma-separated list
+    const char *comma = strrchr(word, ',');
+    const size_t list_length = (comma == NULL) ? 0 : (size_t)(comma - word) + 1;
+    const char *prefix = word + list_length;
+    if (prefix[0] == '@')
+    {
+        complete_ids(word, list_length, status);
+        return;
+    }
+    if (prefix[strspn(prefix, "0123456789")] != '\0') return;
+    const size_t prefix_length = strlen(prefix);
+
+    //Read lazily, stop when screen is full
+    struct CharBuffer path = { 0 };
+    kpd_find_target(&path);
+    FILE *file = fopen(path.p, "r");
+    string_finalize(&path);
+    if (file == NULL) return;
+    struct CharBuffer line = { 0 };
+    string_set_size(&line, INITIAL_BUFFER_SIZE);
+    size_t number = 0;
+    size_t candidates = 0;
+    while (candidates < COMPLETE_LIMIT && string_set_line(&line, file))
+    {
+        //Check beginning only, parse candidates only
+        if (line.size < 7 || memcmp(line.p, " - [", 4) != 0 || (line.p[4] != ' ' && line.p[4] != 'X') || memcmp(line.p + 5, "] ", 2) != 0) continue;
+        number++;
+        if ((status == STA_OPEN && line.p[4] == 'X') || (status == STA_DONE && line.p[4] != 'X')) continue;
+        char number_string[24];
+        snprintf(number_string, sizeof(number_string), "%u", (unsigned int)number);
+        if (strncmp(number_string, prefix, prefix_length) != 0) continue;
+        struct Entry entry = { 0 };
+        kpd_read_line(&entry, &line);
+        printf("%.*s%s\t%s\n", (int)list_length, word, number_string, entry.description);
+        candidates++;
+    }
+
+    //Cleanup
+    string_finalize(&line);
+    fclose(file);
+}
+
+static void complete_arguments(const char *command, size_t argc, char **argv, const char *word, bool numbers)
+{
+    const char *commit_strings[] = { "commit" };
+    const char *watch_strings[] = { "list", "sort", "next", "agenda" };
+    const char *shell_strings[] = { "bash", "zsh", "fish" };
+    if (strcmp(command, "priority") == 0)
+    {
+        if (argc < 2) complete_keywords(word, kpd_priority_strings, sizeof(kpd_priority_strings)/sizeof(*kpd_priority_strings));
+        if (argc == 0 && numbers) complete_numbers(word, STA_ALL);
+    }
+    else if (strcmp(command, "edit") == 0 || strcmp(command, "commit") == 0)
+    {
+        if (argc == 0 && numbers) complete_numbers(word, STA_ALL);
+    }
+    else if (strcmp(command, "remove") == 0 || strcmp(command, "done") == 0 || strcmp(command, "undo") == 0)
+    {
+        if (argc == 0 || (argc == 1 && !kpd_resolve_commit(argv[0]))) complete_keywords(word, commit_strings, 1);
+        const enum Status status = (command[0] == 'd') ? STA_OPEN : (command[0] == 'u') ? STA_DONE : STA_ALL;
+        if (argc == 0 && numbers) complete_numbers(word, status);
+    }
+    else if (strcmp(command, "list") == 0 || strcmp(command, "count") == 0)
+    {
+        if (argc == 0) complete_keywords(word, kpd_status_strings, sizeof(kpd_status_strings)/sizeof(*kpd_status_strings));
+        if (argc < 2) complete_keywords(word, kpd_priority_strings, sizeof(kpd_priority_strings)/sizeof(*kpd_priority_strings));
+    }
+    else if (strcmp(command, "sort") == 0)
+    {
+        if (argc == 0) complete_keywords(word, kpd_status_strings, sizeof(kpd_status_strings)/sizeof(*kpd_status_strings));
+    }
+    else if (strcmp(command, "find") == 0 || strcmp(command, "pick") == 0)
+    {
+        //Description of find, then optional status, then action with its arguments
+        const size_t status_position = (command[0] == 'f') ? 1 : 0;
+        if (argc < status_position) return;
+        enum Status status;
+        const size_t action_position = (argc > status_position && kpd_resolve_status(&status, argv[status_position])) ? (status_position + 1) : status_position;
+        if (argc == status_position) complete_keywords(word, kpd_status_strings, sizeof(kpd_status_strings)/sizeof(*kpd_status_strings));
+        if (argc == action_position)
+        {
+            complete_keywords(word, kpd_action_strings, sizeof(kpd_action_strings)/sizeof(*kpd_action_strings));
+            return;
+        }
+        enum Action action;
+        if (argc < action_position || !kpd_resolve_action(&action, argv[action_position])) return;
+        const size_t action_argc = argc - action_position - 1;
+        if (action == ACT_PRIORITY && action_argc == 0)
+            complete_keywords(word, kpd_priority_strings, sizeof(kpd_priority_strings)/sizeof(*kpd_priority_strings));
+        else if ((action == ACT_REMOVE || action == ACT_DONE || action == ACT_UNDO) && action_argc == 0)
+            complete_keywords(word, commit_strings, 1);
+    }
+    else if (strcmp(command, "watch") == 0)
+    {
+        if (argc == 0)
+        {
+            complete_keywords(word, watch_strings, sizeof(watch_strings)/sizeof(*watch_strings));
+            return;
+        }
+        size_t watch_index;
+        if (string_resolve(&watch_index, argv[0], watch_strings, sizeof(watch_strings)/sizeof(*watch_strings)))
+            complete_arguments(watch_strings[watch_index], argc - 1, argv + 1, word, numbers);
+    }
+    else if (strcmp(command, "import") == 0)
+    {
+        if (argc == 0 || (argc == 1 && !kpd_resolve_commit(argv[0]))) complete_keywords(word, commit_strings, 1);
+    }
+    else if (strcmp(command, "archive") == 0 || strcmp(command, "dedupe") == 0)
+    {
+        if (argc == 0) complete_keywords(word, commit_strings, 1);
+    }
+    else if (strcmp(command, "completion") == 0)
+    {
+        if (argc == 0) complete_keywords(word, shell_strings, sizeof(shell_strings)/sizeof(*shell_strings));
+    }
+}
+
+int complete_run(int argc, char **argv, const char *const *commands, size_t commands_size)
+{
+    if (argc < 1) return ERR_OK;
+    const char *word = argv[argc - 1];
+
+    //Separate options from positional words, skip program name
+    char **positional = malloc((size_t)argc * sizeof(*positional));
+    if (positional == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    size_t positional_size = 0;
+    bool numbers = true;
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "-") == 0 || strcmp(argv[i], "--stdin") == 0) numbers = false;
+        else if (strncmp(argv[i], "--", 2) == 0 && strcmp(argv[i], "--dry-run") != 0 && strcmp(argv[i], "--due") != 0 && strcmp(argv[i], "--fix") != 0 && strcmp(argv[i], "--history") != 0
+            && strcmp(argv[i], "--rev") != 0 && strcmp(argv[i], "--staged") != 0)
+        {
+            //Numbers are relative to section, do not guess them
+            if (argv[i][2] == 's') numbers = false;
+            if (i == argc - 2)
+            {
+                //Import reads other formats than it prints
+                size_t command_index;
+                const bool import = positional_size > 0 && string_resolve(&command_index, positional[0], commands, commands_size)
+                    && strcmp(commands[command_index], "import") == 0;
+                if (argv[i][2] == 'f' && import) complete_keywords(word, kpd_input_strings, sizeof(kpd_input_strings)/sizeof(*kpd_input_strings));
+                else if (argv[i][2] == 'f') complete_keywords(word, kpd_format_strings, sizeof(kpd_format_strings)/sizeof(*kpd_format_strings));
+                free(positional);
+                return ERR_OK;
+            }
+            i++;
+        }
+        else positional[positional_size++] = argv[i];
+    }
+
+    //Complete options, command or its arguments
+    if (word[0] == '-')
+    {
+        const char *global_strings[] = { "-", "--stdin", "--section", "--help", "--version" };
+        const char *format_strings[] = { "--days", "--dry-run", "--due", "--fix", "--format", "--history", "--limit", "--offset", "--older-than", "--rev", "--section", "--since", "--staged" };
+        if (positional_size == 0) complete_keywords(word, global_strings, sizeof(global_strings)/sizeof(*global_strings));
+        else complete_keywords(word, format_strings, sizeof(format_strings)/sizeof(*format_strings));
+    }
+    else if (positional_size == 0)
+    {
+        complete_keywords(word, commands, commands_size);
+    }
+    else
+    {
+        size_t command_index;
+        if (string_resolve(&command_index, positional[0], commands, commands_size))
+            complete_arguments(commands[command_index], positional_size - 1, positional + 1, word, numbers);
+    }
+
+    //Cleanup
+    free(positional);
+    return ERR_OK;
+}
+
+int complete_script(const char *shell)
+{
+    const char *shell_strings[] = { "bash", "zsh", "fish" };
+    size_t shell_index;
+    if (!string_resolve(&shell_index, shell, shell_strings, sizeof(shell_strings)/sizeof(*shell_strings)))
+        kpd_error(ERR_USAGE, "'%s' is not a supported shell", shell);
+    if (shell_index == 0)
+    {
+        printf(
+            "_kpd()\n"
+            "{\n"
+            "    local IFS=$'\\n'\n"
+            "    COMPREPLY=($(kpd __complete \"${COMP_WORDS[@]:0:COMP_CWORD+1}\" 2>/dev/null | cut -f1))\n"
+            "}\n"
+            "complete -o default -F _kpd kpd\n"
+        );
+    }
+    else if (shell_index == 1)
+    {
+        printf(
+            "#compdef kpd\n"
+            "_kpd()\n"
+            "{\n"
+            "    local -a candidates\n"
+            "    candidates=(${(f)\"$(kpd __complete \"${(@)words[1,CURRENT]}\" 2>/dev/null)\"})\n"
+            "    candidates=(\"${(@)candidates//:/\\\\:}\")\n"
+            "    candidates=(\"${(@)candidates/$'\\t'/:}\")\n"
+            "    _describe kpd candidates\n"
+            "}\n"
+            "compdef _kpd kpd\n"
+        );
+    }
+    else
+    {
+        printf(
+            "function __kpd_complete\n"
+            "    set -l word (commandline -ct)\n"
+            "    kpd __complete (commandline -opc) \"$word\" 2>/dev/null\n"
+            "end\n"
+            "complete -c kpd -f -a '(__kpd_complete)'\n"
+        );
+    }
+    return ERR_OK;
+}
@@ -0,0 +1,84 @@
+#include "kpd.h"
+
+#include <stdint.h>
+#include <string.h>
+
+///Sixteen bytes compared at once
+typedef char ByteVector __attribute__((vector_size(16)));
+///Result of comparison of ByteVector, all bits set in matching bytes
+typedef signed char MatchVector __attribute__((vector_size(16)));
+
+//Needed by count_task
+static const char *count_find(const char *p, const char *end)
+{
+    //Skip blocks without line ends and markers
+    while (p + sizeof(ByteVector) <= end)
+    {
+        ByteVector vector;
+        memcpy(&vector, p, sizeof(vector));
+        const MatchVector match = (vector == '\n') | (vector == '(');
+        uint64_t halves[2];
+        memcpy(halves, &match, sizeof(halves));
+        if ((halves[0] | halves[1]) == 0)
+        {
+            p += sizeof(ByteVector);
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(ByteVector); i++)
+        {
+            if (match[i] != 0) return p + i;
+        }
+    }
+    for (; p < end; p++)
+    {
+        if (*p == '\n' || *p == '(') return p;
+    }
+    return end;
+}
+
+const char *count_task(unsigned char *flags, const char **line, const char *p, const char *end)
+{
+    while (p < end)
+    {
+        //Same beginning as in kpd_read_line, other lines are skipped whole
+        const bool task = end - p >= 7
+            && memcmp(p, " - [", 4) == 0
+            && (p[4] == ' ' || p[4] == 'X')
+            && p[5] == ']'
+            && p[6] == ' ';
+        if (!task)
+        {
+            const char *endline = memchr(p, '\n', (size_t)(end - p));
+            p = (endline == NULL) ? end : (endline + 1);
+            continue;
+        }
+
+        //Find markers until end of line, lowest priority wins like in kpd_read_line
+        const char *markers[4] = { "(priority: low)", "(priority: medium)", "(priority: high)", "(priority: critical)" };
+        unsigned int priority = 4;
+        const char *found = p;
+        while (true)
+        {
+            found = count_find(found, end);
+            if (found == end || *found == '\n') break;
+            for (unsigned int i = 0; i < priority; i++)
+            {
+                const size_t marker_length = strlen(markers[i]);
+                if ((size_t)(end - found) >= marker_length && memcmp(found, markers[i], marker_length) == 0) priority = i;
+            }
+            found++;
+        }
+        *flags = (unsigned char)(((priority == 4) ? PRI_MEDIUM : (priority | FLAG_EXPLICIT)) | ((p[4] == 'X') ? FLAG_DONE : 0));
+        *line = p;
+        return (found == end) ? end : (found + 1);
+    }
+    return NULL;
+}
+
+void count_scan(size_t counts[2][4], const char *p, size_t size)
+{
+    const char *end = p + size;
+    const char *line;
+    unsigned char flags;
+    while ((p = count_task(&flags, &line, p, end)) != NULL) counts[(flags & FLAG_DONE) != 0][flags & FLAG_PRIORITY]++;
+}
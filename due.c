@@ -0,0 +1,122 @@
+#include "kpd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//Needed by due_parse and due_today
+static unsigned int due_from_civil(unsigned int year, unsigned int month, unsigned int day)
+{
+    //Days since 0000-03-01 plus one, years begin in March so leap days come last
+    const unsigned int shifted_year = (month <= 2) ? (year - 1) : year;
+    const unsigned int era = shifted_year / 400;
+    const unsigned int year_of_era = shifted_year - era * 400;
+    const unsigned int day_of_year = (153 * ((month > 2) ? (month - 3) : (month + 9)) + 2) / 5 + day - 1;
+    const unsigned int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era + 1;
+}
+
+//Needed by due_parse and due_format
+static void due_to_civil(unsigned int *year, unsigned int *month, unsigned int *day, unsigned int due)
+{
+    const unsigned int days = due - 1;
+    const unsigned int era = days / 146097;
+    const unsigned int day_of_era = days - era * 146097;
+    const unsigned int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const unsigned int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const unsigned int shifted_month = (5 * day_of_year + 2) / 153;
+    *day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+    *month = (shifted_month < 10) ? (shifted_month + 3) : (shifted_month - 9);
+    *year = year_of_era + era * 400 + ((*month <= 2) ? 1 : 0);
+}
+
+//Needed by due_heap and due_pop
+static bool due_less(const struct EntryStore *store, size_t a, size_t b)
+{
+    //Earlier date, then higher priority, then earlier entry
+    if (store->dues[a] != store->dues[b]) return store->dues[a] < store->dues[b];
+    const unsigned int priority_a = store->flags[a] & FLAG_PRIORITY;
+    const unsigned int priority_b = store->flags[b] & FLAG_PRIORITY;
+    if (priority_a != priority_b) return priority_a > priority_b;
+    return a < b;
+}
+
+static void due_sift_down(struct DueHeap *heap, size_t position)
+{
+    while (true)
+    {
+        size_t smallest = position;
+        const size_t left = 2 * position + 1;
+        const size_t right = left + 1;
+        if (left < heap->size && due_less(heap->store, heap->p[left], heap->p[smallest])) smallest = left;
+        if (right < heap->size && due_less(heap->store, heap->p[right], heap->p[smallest])) smallest = right;
+        if (smallest == position) return;
+        const size_t swap = heap->p[position];
+        heap->p[position] = heap->p[smallest];
+        heap->p[smallest] = swap;
+        position = smallest;
+    }
+}
+
+unsigned int due_parse(const char *date)
+{
+    //Exactly YYYY-MM-DD, day must exist in month
+    for (size_t i = 0; i < 10; i++)
+    {
+        const bool separator = i == 4 || i == 7;
+        if (separator ? (date[i] != '-') : (date[i] < '0' || date[i] > '9')) return 0;
+    }
+    const unsigned int year = (unsigned int)strtoul(date, NULL, 10);
+    const unsigned int month = (unsigned int)strtoul(date + 5, NULL, 10);
+    const unsigned int day = (unsigned int)strtoul(date + 8, NULL, 10);
+    if (year == 0 || month < 1 || month > 12 || day < 1 || day > 31) return 0;
+    const unsigned int due = due_from_civil(year, month, day);
+    unsigned int check_year, check_month, check_day;
+    due_to_civil(&check_year, &check_month, &check_day, due);
+    return (check_month == month && check_day == day) ? due : 0;
+}
+
+void due_format(char *date, unsigned int due)
+{
+    unsigned int year, month, day;
+    due_to_civil(&year, &month, &day, due);
+    snprintf(date, 11, "%04u-%02u-%02u", year % 10000, month, day);
+}
+
+unsigned int due_today(void)
+{
+    const time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    return due_from_civil((unsigned int)local.tm_year + 1900, (unsigned int)local.tm_mon + 1, (unsigned int)local.tm_mday);
+}
+
+void due_heap(struct DueHeap *heap, const struct EntryStore *store)
+{
+    //Open entries with dates, heapified bottom-up in linear time
+    heap->store = store;
+    heap->size = 0;
+    heap->p = malloc((store->size + 1) * sizeof(*heap->p));
+    if (heap->p == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < store->size; i++)
+    {
+        if (store->dues[i] != 0 && !(store->flags[i] & FLAG_DONE)) heap->p[heap->size++] = i;
+    }
+    for (size_t position = heap->size / 2; position-- > 0;) due_sift_down(heap, position);
+}
+
+bool due_pop(size_t *index, struct DueHeap *heap)
+{
+    if (heap->size == 0) return false;
+    *index = heap->p[0];
+    heap->p[0] = heap->p[--heap->size];
+    due_sift_down(heap, 0);
+    return true;
+}
+
+void due_finalize(struct DueHeap *heap)
+{
+    free(heap->p);
+    memset(heap, 0, sizeof(*heap));
+}
@@ -27,42 +27,72 @@ void entries_finalize(struct EntryBuffer *entries, bool free_descriptions)
         {
             free(entry->description);
         }
+        free(entries->opaque.p);
     }
     free(entries->p);
     memset(entries, 0, sizeof(*entries));
 }
 
-bool entries_highest_open(size_t *index, const struct EntryBuffer *entries)
+size_t entries_dedupe(char *mask, size_t *kept, struct EntryBuffer *entries)
 {
-    const struct Entry *highest = NULL;
-    for (const struct Entry *entry = entries->p; entry < entries->p + entries->size; entry++)
+    //Normalized descriptions, kept in one buffer
+    struct CharBuffer keys = { 0 };
+    struct CharBuffer key = { 0 };
+    size_t *key_offsets = malloc((entries->size + 1) * sizeof(*key_offsets));
+    if (key_offsets == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < entries->size; i++)
     {
-        if (!entry->done && (highest == NULL || entry->priority > highest->priority)) highest = entry;
+        key_offsets[i] = keys.size;
+        string_normalize(&key, entries->p[i].description);
+        string_substitute(&keys, keys.size, 0, key.p, key.size);
     }
-    if (highest == NULL)
-    {
-        return false;
-    }
-    else
+    key_offsets[entries->size] = keys.size;
+
+    //Open addressing with linear probing, at most half full
+    size_t capacity = 1;
+    while (capacity < 2 * entries->size) capacity <<= 1;
+    size_t *table = malloc(capacity * sizeof(*table));
+    if (table == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < capacity; i++) table[i] = SIZE_MAX;
+
+    //Merge duplicates into first occurrence: open state, highest priority and earliest due date win
+    size_t duplicates = 0;
+    for (size_t i = 0; i < entries->size; i++)
     {
-        *index = (size_t)(highest - entries->p);
-        return true;
+        mask[i] = '\0';
+        kept[i] = SIZE_MAX;
+        const char *key_i = keys.p + key_offsets[i];
+        const size_t size_i = key_offsets[i + 1] - key_offsets[i];
+        size_t slot = (size_t)string_hash(key_i, size_i) & (capacity - 1);
+        while (table[slot] != SIZE_MAX)
+        {
+            const size_t j = table[slot];
+            if (key_offsets[j + 1] - key_offsets[j] == size_i && memcmp(keys.p + key_offsets[j], key_i, size_i) == 0) break;
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == SIZE_MAX)
+        {
+            table[slot] = i;
+            continue;
+        }
+        struct Entry *first = &entries->p[table[slot]];
+        const struct Entry *duplicate = &entries->p[i];
+        first->done = first->done && duplicate->done;
+        if (duplicate->priority > first->priority || (duplicate->priority == first->priority && duplicate->priority_explicit))
+        {
+            first->priority = duplicate->priority;
+            first->priority_explicit = first->priority_explicit || duplicate->priority_explicit;
+        }
+        if (duplicate->due != 0 && (first->due == 0 || duplicate->due < first->due)) first->due = duplicate->due;
+        mask[i] = '\1';
+        kept[i] = table[slot];
+        duplicates++;
     }
-}
 
-static int entries_compare(const void *a, const void *b)
-{
-    const struct Entry *ac = a;
-    const struct Entry *bc = b;
-    int difference = (bc->done ? 0 : 1) - (ac->done ? 0 : 1);
-    if (difference != 0) return difference;
-    difference = (int)(bc->priority) - (int)(ac->priority);
-    if (difference != 0) return difference;
-    difference = (int)(ac->number) - (int)(bc->number);
-    return difference;
-}
-
-void entries_sort(const struct EntryBuffer *entries)
-{
-    qsort(entries->p, entries->size, sizeof(*entries->p), entries_compare);
+    //Cleanup
+    free(table);
+    free(key_offsets);
+    free(key.p);
+    free(keys.p);
+    return duplicates;
 }
@@ -0,0 +1,346 @@
+#include "kpd.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Needed by graph_build
+static size_t graph_reference(const char *p, size_t length, const struct EntryBuffer *entries, struct IdIndex *index)
+{
+    //Number of task in whole TODO.md or @ID like in kpd_parse_number, SIZE_MAX if it matches no task
+    if (p[0] == '@')
+    {
+        if (length < 5 || length > 17) return SIZE_MAX;
+        for (size_t i = 1; i < length; i++)
+        {
+            if (!(p[i] >= '0' && p[i] <= '9') && !(p[i] >= 'a' && p[i] <= 'f')) return SIZE_MAX;
+        }
+        if (index->hashes == NULL) id_index(index, entries);
+        return id_lookup(index, p + 1, length - 1);
+    }
+    size_t number = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (p[i] < '0' || p[i] > '9' || number > entries->first + entries->size) return SIZE_MAX;
+        number = 10 * number + (size_t)(p[i] - '0');
+    }
+    return (number > entries->first && number <= entries->first + entries->size) ? (number - entries->first - 1) : SIZE_MAX;
+}
+
+static void graph_edge(struct Graph *graph, size_t source, size_t target)
+{
+    if (graph->edges == graph->edges_capacity)
+    {
+        graph->edges_capacity = (graph->edges_capacity == 0) ? 16 : (2 * graph->edges_capacity);
+        size_t *new_sources = realloc(graph->sources, graph->edges_capacity * sizeof(*graph->sources));
+        if (new_sources == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        graph->sources = new_sources;
+        size_t *new_targets = realloc(graph->targets, graph->edges_capacity * sizeof(*graph->targets));
+        if (new_targets == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        graph->targets = new_targets;
+        size_t *new_next = realloc(graph->next, graph->edges_capacity * sizeof(*graph->next));
+        if (new_next == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        graph->next = new_next;
+    }
+
+    //Unresolved references are kept for kpd test, but lead nowhere
+    const size_t edge = graph->edges++;
+    graph->sources[edge] = source;
+    graph->targets[edge] = target;
+    graph->next[edge] = SIZE_MAX;
+    if (source == SIZE_MAX) return;
+    graph->next[edge] = graph->heads[source];
+    graph->heads[source] = edge;
+    if (!(graph->flags[source] & FLAG_DONE)) graph->degrees[target]++;
+}
+
+//Needed by graph_build and graph_set_done
+static void graph_update(struct Graph *graph, size_t entry)
+{
+    //Entry is in ready set of its priority if open and without open prerequisites
+    uint64_t *word = &graph->ready[(graph->flags[entry] & FLAG_PRIORITY) * graph->words + entry / 64];
+    const uint64_t bit = (uint64_t)1 << (entry % 64);
+    if ((graph->flags[entry] & FLAG_DONE) || graph->degrees[entry] > 0) *word &= ~bit;
+    else *word |= bit;
+}
+
+//Needed by graph_build and graph_build_store
+static void graph_init(struct Graph *graph, size_t size)
+{
+    memset(graph, 0, sizeof(*graph));
+    graph->size = size;
+    graph->words = (size + 63) / 64;
+    graph->heads = malloc((size + 1) * sizeof(*graph->heads));
+    graph->degrees = calloc(size + 1, sizeof(*graph->degrees));
+    graph->flags = malloc(size + 1);
+    graph->ready = calloc(4 * graph->words + 1, sizeof(*graph->ready));
+    if (graph->heads == NULL || graph->degrees == NULL || graph->flags == NULL || graph->ready == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < size; i++) graph->heads[i] = SIZE_MAX;
+}
+
+void graph_build(struct Graph *graph, const struct EntryBuffer *entries)
+{
+    graph_init(graph, entries->size);
+    for (size_t i = 0; i < entries->size; i++)
+    {
+        graph->flags[i] = (unsigned char)(entries->p[i].priority | (entries->p[i].done ? FLAG_DONE : 0));
+    }
+
+    //Edges of markers, in one pass over descriptions
+    struct IdIndex index = { 0 };
+    for (size_t i = 0; i < entries->size; i++)
+    {
+        for (const char *marker = strstr(entries->p[i].description, GRAPH_MARKER); marker != NULL; marker = strstr(marker + 1, GRAPH_MARKER))
+        {
+            //References are separated by commas or spaces
+            const char *p = marker + strlen(GRAPH_MARKER);
+            while (true)
+            {
+                p += strspn(p, " ,");
+                const size_t length = strcspn(p, " ,)");
+                if (length == 0) break;
+                graph_edge(graph, graph_reference(p, length, entries, &index), i);
+                p += length;
+            }
+        }
+    }
+    if (index.hashes != NULL) id_finalize(&index);
+
+    //Ready sets
+    for (size_t i = 0; i < entries->size; i++) graph_update(graph, i);
+}
+
+void graph_build_store(struct Graph *graph, const struct EntryStore *store)
+{
+    //Entries are only viewed if some description has markers
+    for (size_t i = 0; i < store->size; i++)
+    {
+        if (strstr(store->blob.p + store->offsets[i], GRAPH_MARKER) == NULL) continue;
+        struct EntryBuffer entries = { 0 };
+        store_view(&entries, store, NULL, NULL);
+        entries.first = store->first;
+        graph_build(graph, &entries);
+        entries_finalize(&entries, false);
+        return;
+    }
+    graph_init(graph, store->size);
+    for (size_t i = 0; i < store->size; i++)
+    {
+        graph->flags[i] = store->flags[i] & (FLAG_PRIORITY | FLAG_DONE);
+        graph_update(graph, i);
+    }
+}
+
+bool graph_blocked(const struct Graph *graph, size_t entry)
+{
+    return !(graph->flags[entry] & FLAG_DONE) && graph->degrees[entry] > 0;
+}
+
+void graph_unblocked(char *mask, const struct Graph *graph)
+{
+    if (graph->edges == 0) return;
+    for (size_t i = 0; i < graph->size; i++)
+    {
+        if (graph_blocked(graph, i)) mask[i] = '\0';
+    }
+}
+
+bool graph_next(size_t *index, const struct Graph *graph)
+{
+    //First ready entry of highest priority
+    for (size_t priority = PRI_CRITICAL + 1; priority-- > PRI_LOW;)
+    {
+        const uint64_t *ready = graph->ready + priority * graph->words;
+        for (size_t w = 0; w < graph->words; w++)
+        {
+            if (ready[w] == 0) continue;
+            *index = 64 * w + (size_t)__builtin_ctzll(ready[w]);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t graph_set_done(char *changed, struct Graph *graph, size_t entry, bool done)
+{
+    //Only dependents of entry change, their in-degrees count open prerequisites
+    if (((graph->flags[entry] & FLAG_DONE) != 0) == done) return 0;
+    graph->flags[entry] = (unsigned char)(done ? (graph->flags[entry] | FLAG_DONE) : (graph->flags[entry] & ~FLAG_DONE));
+    graph_update(graph, entry);
+    size_t changed_size = 0;
+    for (size_t edge = graph->heads[entry]; edge != SIZE_MAX; edge = graph->next[edge])
+    {
+        const size_t target = graph->targets[edge];
+        const bool blocked = graph_blocked(graph, target);
+        if (done) graph->degrees[target]--;
+        else graph->degrees[target]++;
+        graph_update(graph, target);
+        if (blocked == graph_blocked(graph, target) || changed[target]) continue;
+        changed[target] = '\1';
+        changed_size++;
+    }
+    return changed_size;
+}
+
+void graph_renumber(struct EntryBuffer *entries, const char *mask, const size_t *redirect)
+{
+    //Numbers after removal of entries in mask, only if some entry has dependencies
+    size_t marked = 0;
+    while (marked < entries->size && (mask[marked] || strstr(entries->p[marked].description, GRAPH_MARKER) == NULL)) marked++;
+    if (marked == entries->size) return;
+    size_t *numbers = malloc((entries->size + 1) * sizeof(*numbers));
+    if (numbers == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    size_t number = 0;
+    for (size_t i = 0; i < entries->size; i++) numbers[i] = mask[i] ? SIZE_MAX : number++;
+
+    //IDs are hashes of old descriptions, so index is built before any is rewritten
+    struct IdIndex index = { 0 };
+    id_index(&index, entries);
+    struct CharBuffer description = { 0 };
+    for (size_t i = 0; i < entries->size; i++)
+    {
+        const char *old = entries->p[i].description;
+        if (mask[i] || strstr(old, GRAPH_MARKER) == NULL) continue;
+        string_set_size(&description, 0);
+        const char *copied = old;
+        for (const char *marker = strstr(old, GRAPH_MARKER); marker != NULL; marker = strstr(marker + 1, GRAPH_MARKER))
+        {
+            //References to removed entries are dropped like done prerequisites unless redirected, numbers are shifted
+            string_substitute(&description, description.size, 0, copied, (size_t)(marker - copied));
+            const size_t before = description.size;
+            string_substitute(&description, description.size, 0, GRAPH_MARKER, strlen(GRAPH_MARKER));
+            size_t kept = 0;
+            const char *p = marker + strlen(GRAPH_MARKER);
+            while (true)
+            {
+                p += strspn(p, " ,");
+                const size_t length = strcspn(p, " ,)");
+                if (length == 0) break;
+                const size_t found = graph_reference(p, length, entries, &index);
+                const size_t reference = (found != SIZE_MAX && mask[found] && redirect != NULL) ? redirect[found] : found;
+                if (reference != SIZE_MAX && (mask[reference] || (reference != found && reference == i)))
+                {
+                    p += length;
+                    continue;
+                }
+                string_substitute(&description, description.size, 0, (kept == 0) ? " " : ", ", (kept == 0) ? 1 : 2);
+                kept++;
+                if (reference == SIZE_MAX || (p[0] == '@' && reference == found))
+                {
+                    string_substitute(&description, description.size, 0, p, length);
+                }
+                else
+                {
+                    char string[24];
+                    if (p[0] == '@')
+                    {
+                        string[0] = '@';
+                        id_format(string + 1, &index, reference);
+                    }
+                    else snprintf(string, sizeof(string), "%u", (unsigned int)(entries->first + numbers[reference] + 1));
+                    string_substitute(&description, description.size, 0, string, strlen(string));
+                }
+                p += length;
+            }
+            copied = p;
+
+            //Marker without references is removed with space before it
+            if (kept == 0 && *p == ')')
+            {
+                string_set_size(&description, (before > 0 && description.p[before - 1] == ' ') ? (before - 1) : before);
+                copied = p + 1;
+            }
+        }
+        string_substitute(&description, description.size, 0, copied, strlen(copied));
+
+        //Buffer becomes new description, next one gets a new buffer
+        free(entries->p[i].description);
+        entries->p[i].description = description.p;
+        description = (struct CharBuffer){ 0 };
+    }
+
+    //Cleanup
+    id_finalize(&index);
+    free(description.p);
+    free(numbers);
+}
+
+size_t graph_cycles(char *mask, const struct Graph *graph)
+{
+    //Kahn's algorithm forward and backward, entries left by both are on cycles or between them
+    size_t *in = calloc(graph->size + 1, sizeof(*in));
+    size_t *out = calloc(graph->size + 1, sizeof(*out));
+    size_t *reverse_heads = malloc((graph->size + 1) * sizeof(*reverse_heads));
+    size_t *reverse_next = malloc((graph->edges + 1) * sizeof(*reverse_next));
+    size_t *queue = malloc((graph->size + 1) * sizeof(*queue));
+    if (in == NULL || out == NULL || reverse_heads == NULL || reverse_next == NULL || queue == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < graph->size; i++) reverse_heads[i] = SIZE_MAX;
+    for (size_t edge = 0; edge < graph->edges; edge++)
+    {
+        if (graph->sources[edge] == SIZE_MAX) continue;
+        in[graph->targets[edge]]++;
+        out[graph->sources[edge]]++;
+        reverse_next[edge] = reverse_heads[graph->targets[edge]];
+        reverse_heads[graph->targets[edge]] = edge;
+    }
+    for (size_t i = 0; i < graph->size; i++) mask[i] = '\2';
+
+    //Forward, entries without prerequisites first
+    size_t queue_size = 0;
+    for (size_t i = 0; i < graph->size; i++)
+    {
+        if (in[i] == 0) queue[queue_size++] = i;
+    }
+    for (size_t k = 0; k < queue_size; k++)
+    {
+        mask[queue[k]]--;
+        for (size_t edge = graph->heads[queue[k]]; edge != SIZE_MAX; edge = graph->next[edge])
+        {
+            if (--in[graph->targets[edge]] == 0) queue[queue_size++] = graph->targets[edge];
+        }
+    }
+
+    //Backward, entries without dependents first
+    queue_size = 0;
+    for (size_t i = 0; i < graph->size; i++)
+    {
+        if (out[i] == 0) queue[queue_size++] = i;
+    }
+    for (size_t k = 0; k < queue_size; k++)
+    {
+        mask[queue[k]]--;
+        for (size_t edge = reverse_heads[queue[k]]; edge != SIZE_MAX; edge = reverse_next[edge])
+        {
+            if (--out[graph->sources[edge]] == 0) queue[queue_size++] = graph->sources[edge];
+        }
+    }
+
+    //Left by both passes
+    size_t cycles = 0;
+    for (size_t i = 0; i < graph->size; i++)
+    {
+        mask[i] = (mask[i] == '\2') ? '\1' : '\0';
+        cycles += (size_t)mask[i];
+    }
+
+    //Cleanup
+    free(queue);
+    free(reverse_next);
+    free(reverse_heads);
+    free(out);
+    free(in);
+    return cycles;
+}
+
+void graph_finalize(struct Graph *graph)
+{
+    free(graph->heads);
+    free(graph->sources);
+    free(graph->targets);
+    free(graph->next);
+    free(graph->degrees);
+    free(graph->flags);
+    free(graph->ready);
+    memset(graph, 0, sizeof(*graph));
+}
@@ -0,0 +1,335 @@
+#include "kpd.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+///Kind of change of task
+enum HistoryKind
+{
+    HIS_ADDED,
+    HIS_DONE,
+    HIS_REOPENED,
+    HIS_PRIORITY,
+    HIS_REMOVED
+};
+
+///Change of task found in history
+struct HistoryEvent
+{
+    long time;              ///< Committer time
+    size_t task;            ///< Index of task in store
+    enum HistoryKind kind;  ///< Kind of change
+    unsigned char flags;    ///< Flags of task after change, see FLAG_*
+};
+
+///Task line added or removed by commit
+struct HistoryLine
+{
+    size_t task;            ///< Index of task in store, SIZE_MAX after removed line is matched
+    unsigned char flags;    ///< Flags of line, see FLAG_*
+    bool added;             ///< Line is added, otherwise removed
+};
+
+///Numbers of tasks at end of day
+struct HistoryDay
+{
+    long time;              ///< Committer time of last commit of day
+    long open;
+    long done;
+};
+
+///History of TODO.md, parsed from one 'git log -p' stream
+struct History
+{
+    struct EntryStore tasks;        ///< Tasks by description, flags of first line
+    size_t *slots;                  ///< Index of tasks by description hash, SIZE_MAX for empty slot
+    size_t slots_capacity;          ///< Power of two, at least twice the number of tasks
+    size_t *pending;                ///< Line in removed lines of current commit for every task, SIZE_MAX for none
+    size_t pending_capacity;
+    struct HistoryEvent *events;
+    size_t events_size;
+    size_t events_capacity;
+    struct HistoryDay *days;
+    size_t days_size;
+    size_t days_capacity;
+};
+
+//Needed by history_task, history_commit and history_read
+static void *history_reserve(void *p, size_t *capacity, size_t size, size_t element_size)
+{
+    if (size <= *capacity) return p;
+    size_t new_capacity = (*capacity == 0) ? 1 : *capacity;
+    while (size > new_capacity) new_capacity <<= 1;
+    void *new_p = realloc(p, new_capacity * element_size);
+    if (new_p == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+    *capacity = new_capacity;
+    return new_p;
+}
+
+static void history_insert(struct History *history, size_t task)
+{
+    //Open addressing with linear probing
+    const char *description = history->tasks.blob.p + history->tasks.offsets[task];
+    size_t slot = (size_t)string_hash(description, strlen(description)) & (history->slots_capacity - 1);
+    while (history->slots[slot] != SIZE_MAX) slot = (slot + 1) & (history->slots_capacity - 1);
+    history->slots[slot] = task;
+}
+
+static size_t history_task(struct History *history, const struct Entry *entry)
+{
+    //Find task with same description
+    if (history->slots_capacity > 0)
+    {
+        size_t slot = (size_t)string_hash(entry->description, strlen(entry->description)) & (history->slots_capacity - 1);
+        while (history->slots[slot] != SIZE_MAX)
+        {
+            const size_t task = history->slots[slot];
+            if (strcmp(history->tasks.blob.p + history->tasks.offsets[task], entry->description) == 0) return task;
+            slot = (slot + 1) & (history->slots_capacity - 1);
+        }
+    }
+
+    //New task, index stays at most half full
+    const size_t task = history->tasks.size;
+    store_push(&history->tasks, entry);
+    history->pending = history_reserve(history->pending, &history->pending_capacity, task + 1, sizeof(*history->pending));
+    history->pending[task] = SIZE_MAX;
+    if (2 * history->tasks.size > history->slots_capacity)
+    {
+        history->slots_capacity = (history->slots_capacity == 0) ? 64 : (2 * history->slots_capacity);
+        free(history->slots);
+        history->slots = malloc(history->slots_capacity * sizeof(*history->slots));
+        if (history->slots == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+        for (size_t i = 0; i < history->slots_capacity; i++) history->slots[i] = SIZE_MAX;
+        for (size_t i = 0; i < history->tasks.size; i++) history_insert(history, i);
+    }
+    else
+    {
+        history_insert(history, task);
+    }
+    return task;
+}
+
+static void history_event(struct History *history, long time, size_t task, enum HistoryKind kind, unsigned char flags)
+{
+    history->events = history_reserve(history->events, &history->events_capacity, history->events_size + 1, sizeof(*history->events));
+    struct HistoryEvent *event = &history->events[history->events_size++];
+    event->time = time;
+    event->task = task;
+    event->kind = kind;
+    event->flags = flags;
+}
+
+static void history_commit(struct History *history, long time, struct HistoryLine *lines, size_t lines_size)
+{
+    //Lines removed and added by the same commit are changes of task, lines may move between hunks
+    long open = 0;
+    long done = 0;
+    for (size_t i = 0; i < lines_size; i++)
+    {
+        if (lines[i].added) continue;
+        history->pending[lines[i].task] = i;
+        if (lines[i].flags & FLAG_DONE) done--;
+        else open--;
+    }
+    for (size_t i = 0; i < lines_size; i++)
+    {
+        if (!lines[i].added) continue;
+        const size_t task = lines[i].task;
+        const unsigned char flags = lines[i].flags;
+        if (flags & FLAG_DONE) done++;
+        else open++;
+        const size_t line = history->pending[task];
+        if (line == SIZE_MAX)
+        {
+            history_event(history, time, task, HIS_ADDED, flags);
+            continue;
+        }
+        history->pending[task] = SIZE_MAX;
+        lines[line].task = SIZE_MAX;
+        const unsigned char old_flags = lines[line].flags;
+        if ((flags & FLAG_DONE) && !(old_flags & FLAG_DONE)) history_event(history, time, task, HIS_DONE, flags);
+        if (!(flags & FLAG_DONE) && (old_flags & FLAG_DONE)) history_event(history, time, task, HIS_REOPENED, flags);
+        if ((flags & (FLAG_PRIORITY | FLAG_EXPLICIT)) != (old_flags & (FLAG_PRIORITY | FLAG_EXPLICIT))) history_event(history, time, task, HIS_PRIORITY, flags);
+    }
+    for (size_t i = 0; i < lines_size; i++)
+    {
+        if (lines[i].added || lines[i].task == SIZE_MAX) continue;
+        history->pending[lines[i].task] = SIZE_MAX;
+        history_event(history, time, lines[i].task, HIS_REMOVED, lines[i].flags);
+    }
+
+    //Commits of the same local day update one row
+    time_t t = (time_t)time;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    const long day = (long)tm.tm_year * 400 + tm.tm_yday;
+    bool same_day = false;
+    if (history->days_size > 0)
+    {
+        t = (time_t)history->days[history->days_size - 1].time;
+        localtime_r(&t, &tm);
+        same_day = (long)tm.tm_year * 400 + tm.tm_yday == day;
+    }
+    if (!same_day)
+    {
+        history->days = history_reserve(history->days, &history->days_capacity, history->days_size + 1, sizeof(*history->days));
+        struct HistoryDay *previous = (history->days_size > 0) ? &history->days[history->days_size - 1] : NULL;
+        history->days[history->days_size].open = (previous != NULL) ? previous->open : 0;
+        history->days[history->days_size].done = (previous != NULL) ? previous->done : 0;
+        history->days_size++;
+    }
+    struct HistoryDay *current = &history->days[history->days_size - 1];
+    current->time = time;
+    current->open += open;
+    current->done += done;
+}
+
+static void history_read(struct History *history, const char *path, const char *since)
+{
+    //One git process for whole history, oldest commit first, without context lines, merges once as diff to first parent
+    char *arguments[14] =
+    {
+        "git", "log", "-p", "-U0", "--reverse", "--follow", "--first-parent", "--diff-merges=first-parent",
+        "--no-color", "--no-ext-diff", "--format=commit %ct", NULL, NULL, NULL
+    };
+    size_t arguments_size = 11;
+    char *since_argument = NULL;
+    if (since != NULL)
+    {
+        since_argument = malloc(strlen("--since=") + strlen(since) + 1);
+        if (since_argument == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+        sprintf(since_argument, "--since=%s", since);
+        arguments[arguments_size++] = since_argument;
+    }
+    arguments[arguments_size++] = "--";
+    arguments[arguments_size] = strdup(path);
+    if (arguments[arguments_size] == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+    char *path_argument = arguments[arguments_size++];
+    int id;
+    FILE *file = kpd_open_git(arguments, &id);
+
+    //Collect task lines of commit, process them at next commit
+    struct CharBuffer line = { 0 };
+    string_set_size(&line, INITIAL_BUFFER_SIZE);
+    struct HistoryLine *lines = NULL;
+    size_t lines_size = 0;
+    size_t lines_capacity = 0;
+    const char *commit_key = "commit ";
+    long time = 0;
+    bool commit = false;
+    while (true)
+    {
+        const bool read = string_set_line(&line, file);
+        if (!read || strncmp(line.p, commit_key, strlen(commit_key)) == 0)
+        {
+            if (commit) history_commit(history, time, lines, lines_size);
+            if (!read) break;
+            time = strtol(line.p + strlen(commit_key), NULL, 10);
+            lines_size = 0;
+            commit = true;
+            continue;
+        }
+
+        //Only changed task lines matter, headers of diff never start with " - ["
+        if (line.p[0] != '-' && line.p[0] != '+') continue;
+        const bool added = line.p[0] == '+';
+        string_substitute(&line, 0, 1, "", 0);
+        struct Entry entry = { 0 };
+        if (!kpd_read_line(&entry, &line)) continue;
+        lines = history_reserve(lines, &lines_capacity, lines_size + 1, sizeof(*lines));
+        struct HistoryLine *task_line = &lines[lines_size++];
+        task_line->task = history_task(history, &entry);
+        task_line->added = added;
+        task_line->flags = (unsigned char)((unsigned char)entry.priority
+            | (entry.priority_explicit ? FLAG_EXPLICIT : 0)
+            | (entry.done ? FLAG_DONE : 0));
+    }
+    kpd_close_git(file, id);
+
+    //Cleanup
+    free(lines);
+    free(line.p);
+    free(path_argument);
+    free(since_argument);
+}
+
+static void history_finalize(struct History *history)
+{
+    store_finalize(&history->tasks);
+    free(history->slots);
+    free(history->pending);
+    free(history->events);
+    free(history->days);
+    memset(history, 0, sizeof(*history));
+}
+
+//Needed by history_log and history_counts
+static void history_date(char *date, size_t size, long time)
+{
+    const time_t t = (time_t)time;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    strftime(date, size, "%Y-%m-%d", &tm);
+}
+
+void history_log(const char *path, const char *since)
+{
+    struct History history = { 0 };
+    history_read(&history, path, since);
+
+    //Group events by task with counting sort, tasks in order of first change
+    size_t *positions = calloc(history.tasks.size + 1, sizeof(*positions));
+    size_t *order = malloc((history.events_size + 1) * sizeof(*order));
+    if (positions == NULL || order == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < history.events_size; i++) positions[history.events[i].task + 1]++;
+    for (size_t i = 1; i <= history.tasks.size; i++) positions[i] += positions[i - 1];
+    for (size_t i = 0; i < history.events_size; i++) order[positions[history.events[i].task]++] = i;
+
+    //Print timelines
+    const char *kind_strings[5] = { "added", "done", "reopened", "priority", "removed" };
+    size_t k = 0;
+    for (size_t task = 0; task < history.tasks.size; task++)
+    {
+        if (k == positions[task]) continue;
+        printf("%s\n", history.tasks.blob.p + history.tasks.offsets[task]);
+        for (; k < positions[task]; k++)
+        {
+            const struct HistoryEvent *event = &history.events[order[k]];
+            char date[32];
+            history_date(date, sizeof(date), event->time);
+            const enum Priority priority = (enum Priority)(event->flags & FLAG_PRIORITY);
+            printf("    %s  %s", date, kind_strings[event->kind]);
+            if (event->kind == HIS_ADDED && (event->flags & FLAG_DONE)) printf(" as done");
+            if (event->kind == HIS_PRIORITY) printf(": %s", kpd_priority_strings[priority]);
+            if (event->kind == HIS_ADDED && (event->flags & FLAG_EXPLICIT)) printf(" (priority: %s)", kpd_priority_strings[priority]);
+            printf("\n");
+        }
+    }
+
+    //Cleanup
+    free(order);
+    free(positions);
+    history_finalize(&history);
+}
+
+void history_counts(const char *path)
+{
+    struct History history = { 0 };
+    history_read(&history, path, NULL);
+
+    //Print last numbers of every day
+    for (size_t i = 0; i < history.days_size; i++)
+    {
+        const struct HistoryDay *day = &history.days[i];
+        char date[32];
+        history_date(date, sizeof(date), day->time);
+        printf("%s  %6ld open  %6ld done\n", date, day->open, day->done);
+    }
+
+    //Cleanup
+    history_finalize(&history);
+}
@@ -0,0 +1,115 @@
+#include "kpd.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ID_MIN_LENGTH 4     //Digits of shortest ID, every ID determines its bucket
+#define ID_MAX_LENGTH 16    //Digits of whole hash
+
+//Needed by id_index, id_find, id_lookup and id_match
+static size_t id_bucket(const struct IdIndex *index, uint64_t hash)
+{
+    return (size_t)(hash >> (64 - 4 * ID_MIN_LENGTH)) & (index->buckets - 1);
+}
+
+static uint64_t id_prefix(uint64_t *prefix_mask, const char *id, size_t id_length)
+{
+    //Digits are the highest bits of hash
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < id_length; i++)
+    {
+        const char c = id[i];
+        const unsigned int digit = (c >= '0' && c <= '9') ? (unsigned int)(c - '0') : (unsigned int)(c - 'a' + 10);
+        prefix = (prefix << 4) | digit;
+    }
+    *prefix_mask = (id_length == ID_MAX_LENGTH) ? UINT64_MAX : ~(UINT64_MAX >> (4 * id_length));
+    return prefix << (4 * (ID_MAX_LENGTH - id_length));
+}
+
+void id_index(struct IdIndex *index, const struct EntryBuffer *entries)
+{
+    //Buckets of first four digits, chained
+    index->size = entries->size;
+    index->buckets = 1;
+    while (index->buckets < entries->size && index->buckets < ((size_t)1 << (4 * ID_MIN_LENGTH))) index->buckets <<= 1;
+    index->hashes = malloc((entries->size + 1) * sizeof(*index->hashes));
+    index->next = malloc((entries->size + 1) * sizeof(*index->next));
+    index->heads = malloc(index->buckets * sizeof(*index->heads));
+    if (index->hashes == NULL || index->next == NULL || index->heads == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < index->buckets; i++) index->heads[i] = SIZE_MAX;
+    for (size_t i = entries->size; i-- > 0;)
+    {
+        const char *description = entries->p[i].description;
+        index->hashes[i] = string_hash(description, strlen(description));
+        const size_t bucket = id_bucket(index, index->hashes[i]);
+        index->next[i] = index->heads[bucket];
+        index->heads[bucket] = i;
+    }
+}
+
+bool id_find(char *mask, const struct IdIndex *index, const char *id, size_t id_length)
+{
+    //Prefix of hash
+    uint64_t prefix_mask;
+    const uint64_t prefix = id_prefix(&prefix_mask, id, id_length);
+
+    //Entries with equal descriptions share ID
+    bool found = false;
+    uint64_t found_hash = 0;
+    for (size_t i = index->heads[id_bucket(index, prefix)]; i != SIZE_MAX; i = index->next[i])
+    {
+        if ((index->hashes[i] & prefix_mask) != prefix) continue;
+        if (found && index->hashes[i] != found_hash) kpd_error(ERR_USAGE, "'@%.*s' is ambiguous", (int)id_length, id);
+        found = true;
+        found_hash = index->hashes[i];
+        mask[i] = '\1';
+    }
+    return found;
+}
+
+size_t id_lookup(const struct IdIndex *index, const char *id, size_t id_length)
+{
+    //Like id_find, chains are in order of entries
+    uint64_t prefix_mask;
+    const uint64_t prefix = id_prefix(&prefix_mask, id, id_length);
+    size_t found = SIZE_MAX;
+    for (size_t i = index->heads[id_bucket(index, prefix)]; i != SIZE_MAX; i = index->next[i])
+    {
+        if ((index->hashes[i] & prefix_mask) != prefix) continue;
+        if (found != SIZE_MAX && index->hashes[i] != index->hashes[found]) return SIZE_MAX;
+        if (found == SIZE_MAX) found = i;
+    }
+    return found;
+}
+
+bool id_match(const char *description, const char *id, size_t id_length)
+{
+    uint64_t prefix_mask;
+    const uint64_t prefix = id_prefix(&prefix_mask, id, id_length);
+    return (string_hash(description, strlen(description)) & prefix_mask) == prefix;
+}
+
+void id_format(char *id, const struct IdIndex *index, size_t number)
+{
+    //Shortest prefix not shared with other descriptions, only the same bucket can share it
+    const uint64_t hash = index->hashes[number];
+    unsigned int length = ID_MIN_LENGTH;
+    for (size_t i = index->heads[id_bucket(index, hash)]; i != SIZE_MAX; i = index->next[i])
+    {
+        if (index->hashes[i] == hash) continue;
+        const unsigned int shared = (unsigned int)__builtin_clzll(index->hashes[i] ^ hash) / 4;
+        if (shared + 1 > length) length = shared + 1;
+    }
+    snprintf(id, ID_MAX_LENGTH + 1, "%016llx", (unsigned long long)hash);
+    id[length] = '\0';
+}
+
+void id_finalize(struct IdIndex *index)
+{
+    free(index->hashes);
+    free(index->next);
+    free(index->heads);
+    memset(index, 0, sizeof(*index));
+}
@@ -0,0 +1,316 @@
+#include "kpd.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Needed by import_record
+static void import_error(size_t line, const char *message, const char *value)
+{
+    if (value == NULL) kpd_error(ERR_FORMAT, "line %u: %s", (unsigned int)line, message);
+    else kpd_error(ERR_FORMAT, "line %u: %s '%s'", (unsigned int)line, message, value);
+}
+
+//Needed by import_csv and import_json
+static void import_record(struct EntryBuffer *records, size_t line, struct CharBuffer *description, const char *priority, const char *done, unsigned int due)
+{
+    //Validate
+    struct Entry entry = { 0 };
+    if (memchr(description->p, '\n', description->size) != NULL || memchr(description->p, '\r', description->size) != NULL)
+        import_error(line, "description contains line break", NULL);
+    if (strlen(description->p) != description->size) import_error(line, "description contains null character", NULL);
+    string_trim(description, 0, 0);
+    if (description->size == 0) import_error(line, "description is empty", NULL);
+    entry.priority = PRI_MEDIUM;
+    if (priority != NULL && priority[0] != '\0')
+    {
+        if (!kpd_resolve_priority(&entry.priority, priority)) import_error(line, "invalid priority", priority);
+        entry.priority_explicit = true;
+    }
+    if (done != NULL && done[0] != '\0')
+    {
+        if (strcmp(done, "true") == 0 || strcmp(done, "X") == 0 || strcmp(done, "x") == 0 || strcmp(done, "1") == 0) entry.done = true;
+        else if (strcmp(done, "false") != 0 && strcmp(done, "0") != 0) import_error(line, "invalid done", done);
+    }
+
+    //Append
+    entry.due = due;
+    entry.description = strdup(description->p);
+    if (entry.description == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+    entries_set_size(records, records->size + 1);
+    records->p[records->size - 1] = entry;
+}
+
+//Needed by import_read
+static void import_lines(struct EntryBuffer *records, const struct CharBuffer *input)
+{
+    struct CharBuffer line = { 0 };
+    size_t number = 1;
+    for (size_t begin = 0; begin < input->size; number++)
+    {
+        const char *endline = memchr(input->p + begin, '\n', input->size - begin);
+        const size_t end = (endline == NULL) ? input->size : (size_t)(endline - input->p) + 1;
+        string_set_size(&line, end - begin);
+        memcpy(line.p, input->p + begin, line.size);
+        begin = end;
+
+        //Lines may be tasks themselves, other lines are descriptions
+        struct Entry entry = { 0 };
+        if (kpd_read_line(&entry, &line))
+        {
+            const char *priority = entry.priority_explicit ? kpd_priority_strings[entry.priority] : NULL;
+            import_record(records, number, &line, priority, entry.done ? "true" : NULL, entry.due);
+            continue;
+        }
+        string_trim(&line, 0, 0);
+        if (line.size > 0) import_record(records, number, &line, NULL, NULL, 0);
+    }
+    free(line.p);
+}
+
+//Needed by import_csv
+static bool import_csv_field(struct CharBuffer *field, const struct CharBuffer *input, size_t *position, size_t *line)
+{
+    //Returns whether another field of the record follows
+    string_set_size(field, 0);
+    size_t i = *position;
+    if (i < input->size && input->p[i] == '"')
+    {
+        //Quoted, "" is a quote
+        const size_t quote_line = *line;
+        for (i++; true; i++)
+        {
+            if (i == input->size) import_error(quote_line, "unterminated quote", NULL);
+            if (input->p[i] == '"')
+            {
+                if (i + 1 < input->size && input->p[i + 1] == '"') i++;
+                else break;
+            }
+            if (input->p[i] == '\n') (*line)++;
+            string_substitute(field, field->size, 0, input->p + i, 1);
+        }
+        i++;
+        if (i < input->size && strchr(",\r\n", input->p[i]) == NULL) import_error(*line, "text after closing quote", NULL);
+    }
+    else
+    {
+        const size_t begin = i;
+        while (i < input->size && strchr(",\r\n", input->p[i]) == NULL) i++;
+        string_substitute(field, 0, 0, input->p + begin, i - begin);
+    }
+    if (i < input->size && input->p[i] == '\r') i++;
+    const bool next = i < input->size && input->p[i] == ',';
+    if (i < input->size) i++;
+    *position = i;
+    return next;
+}
+
+static void import_csv(struct EntryBuffer *records, const struct CharBuffer *input)
+{
+    //Columns: description, priority, done (header is optional)
+    struct CharBuffer fields[3] = { 0 };
+    struct CharBuffer extra = { 0 };
+    size_t line = 1;
+    for (size_t position = 0; position < input->size; line++)
+    {
+        const size_t record_line = line;
+        size_t size = 0;
+        bool next = true;
+        for (; next && size < 3; size++) next = import_csv_field(&fields[size], input, &position, &line);
+        while (next) next = import_csv_field(&extra, input, &position, &line);
+        for (size_t i = size; i < 3; i++) string_set_size(&fields[i], 0);
+        if (size == 1 && fields[0].size == 0) continue; //Empty line
+        if (record_line == 1 && strcmp(fields[0].p, "description") == 0) continue;
+        import_record(records, record_line, &fields[0], fields[1].p, fields[2].p, 0);
+    }
+    for (size_t i = 0; i < 3; i++) free(fields[i].p);
+    free(extra.p);
+}
+
+//Needed by import_json
+static void import_json_space(const struct CharBuffer *input, size_t *position)
+{
+    while (*position < input->size && input->p[*position] != '\0' && strchr(" \t\r", input->p[*position]) != NULL) (*position)++;
+}
+
+static void import_json_utf8(struct CharBuffer *string, uint32_t code)
+{
+    char bytes[4];
+    size_t size;
+    if (code < 0x80) { bytes[0] = (char)code; size = 1; }
+    else if (code < 0x800) { bytes[0] = (char)(0xC0 | (code >> 6)); bytes[1] = (char)(0x80 | (code & 0x3F)); size = 2; }
+    else if (code < 0x10000) { bytes[0] = (char)(0xE0 | (code >> 12)); bytes[1] = (char)(0x80 | ((code >> 6) & 0x3F)); bytes[2] = (char)(0x80 | (code & 0x3F)); size = 3; }
+    else { bytes[0] = (char)(0xF0 | (code >> 18)); bytes[1] = (char)(0x80 | ((code >> 12) & 0x3F)); bytes[2] = (char)(0x80 | ((code >> 6) & 0x3F)); bytes[3] = (char)(0x80 | (code & 0x3F)); size = 4; }
+    string_substitute(string, string->size, 0, bytes, size);
+}
+
+static bool import_json_hex(const struct CharBuffer *input, size_t position, uint32_t *code)
+{
+    if (position + 4 > input->size) return false;
+    *code = 0;
+    for (size_t i = position; i < position + 4; i++)
+    {
+        const char c = input->p[i];
+        const char *digits = "0123456789abcdef0123456789ABCDEF";
+        const char *digit = (c == '\0') ? NULL : strchr(digits, c);
+        if (digit == NULL) return false;
+        *code = (*code << 4) | (uint32_t)((digit - digits) & 0xF);
+    }
+    return true;
+}
+
+static bool import_json_string(struct CharBuffer *string, const struct CharBuffer *input, size_t *position)
+{
+    string_set_size(string, 0);
+    size_t i = *position + 1;
+    while (true)
+    {
+        //Copy unescaped run
+        const size_t begin = i;
+        while (i < input->size && input->p[i] != '"' && input->p[i] != '\\' && input->p[i] != '\n') i++;
+        string_substitute(string, string->size, 0, input->p + begin, i - begin);
+        if (i == input->size || input->p[i] == '\n') return false;
+        if (input->p[i] == '"') break;
+
+        //Escape
+        if (++i == input->size) return false;
+        const char *escapes = "\"\\/bfnrt";
+        const char *replacements = "\"\\/\b\f\n\r\t";
+        const char *escape = (input->p[i] == '\0') ? NULL : strchr(escapes, input->p[i]);
+        if (escape != NULL)
+        {
+            string_substitute(string, string->size, 0, replacements + (escape - escapes), 1);
+            i++;
+            continue;
+        }
+        uint32_t code;
+        if (input->p[i] != 'u' || !import_json_hex(input, i + 1, &code)) return false;
+        i += 5;
+        uint32_t low;
+        if (code >= 0xD800 && code < 0xDC00 && i + 1 < input->size && input->p[i] == '\\' && input->p[i + 1] == 'u'
+            && import_json_hex(input, i + 2, &low) && low >= 0xDC00 && low < 0xE000)
+        {
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            i += 6;
+        }
+        import_json_utf8(string, code);
+    }
+    *position = i + 1;
+    return true;
+}
+
+static bool import_json_skip(const struct CharBuffer *input, size_t *position, struct CharBuffer *scratch)
+{
+    //Skips value that is not needed, nested objects and arrays included
+    import_json_space(input, position);
+    if (*position == input->size) return false;
+    const char c = input->p[*position];
+    if (c == '"') return import_json_string(scratch, input, position);
+    if (c == '{' || c == '[')
+    {
+        const char close = (c == '{') ? '}' : ']';
+        (*position)++;
+        import_json_space(input, position);
+        if (*position < input->size && input->p[*position] == close) { (*position)++; return true; }
+        while (true)
+        {
+            if (c == '{')
+            {
+                import_json_space(input, position);
+                if (*position == input->size || input->p[*position] != '"' || !import_json_string(scratch, input, position)) return false;
+                import_json_space(input, position);
+                if (*position == input->size || input->p[*position] != ':') return false;
+                (*position)++;
+            }
+            if (!import_json_skip(input, position, scratch)) return false;
+            import_json_space(input, position);
+            if (*position == input->size) return false;
+            if (input->p[*position] == close) { (*position)++; return true; }
+            if (input->p[*position] != ',') return false;
+            (*position)++;
+        }
+    }
+    const size_t begin = *position;
+    while (*position < input->size && input->p[*position] != '\0' && strchr("-+.0123456789eEtrufalsn", input->p[*position]) != NULL) (*position)++;
+    return *position > begin;
+}
+
+static void import_json(struct EntryBuffer *records, const struct CharBuffer *input)
+{
+    //One object per line, only description, priority, done and priority_explicit are used
+    struct CharBuffer key = { 0 };
+    struct CharBuffer values[4] = { 0 };
+    struct CharBuffer scratch = { 0 };
+    size_t line = 1;
+    for (size_t position = 0; position < input->size; line++)
+    {
+        import_json_space(input, &position);
+        if (position < input->size && input->p[position] == '\n') { position++; continue; }
+        if (position == input->size) break;
+        if (input->p[position] != '{') import_error(line, "expected object", NULL);
+        position++;
+        bool found[4] = { false, false, false, false };
+        bool first = true;
+        while (true)
+        {
+            import_json_space(input, &position);
+            if (position < input->size && input->p[position] == '}' && first) break;
+            if (position == input->size || input->p[position] != '"' || !import_json_string(&key, input, &position)) import_error(line, "expected key", NULL);
+            import_json_space(input, &position);
+            if (position == input->size || input->p[position] != ':') import_error(line, "expected ':'", NULL);
+            position++;
+            import_json_space(input, &position);
+
+            //Known keys
+            const char *keys[4] = { "description", "priority", "done", "priority_explicit" };
+            size_t k = 0;
+            while (k < 4 && strcmp(key.p, keys[k]) != 0) k++;
+            if (k < 2)
+            {
+                if (position == input->size || input->p[position] != '"' || !import_json_string(&values[k], input, &position))
+                    import_error(line, "expected string for", keys[k]);
+                found[k] = true;
+            }
+            else if (k < 4)
+            {
+                const char *booleans[2] = { "false", "true" };
+                size_t b = 0;
+                while (b < 2 && strncmp(input->p + position, booleans[b], strlen(booleans[b])) != 0) b++;
+                if (b == 2) import_error(line, "expected boolean for", keys[k]);
+                position += strlen(booleans[b]);
+                string_set_size(&values[k], 0);
+                string_substitute(&values[k], 0, 0, booleans[b], strlen(booleans[b]));
+                found[k] = true;
+            }
+            else if (!import_json_skip(input, &position, &scratch)) import_error(line, "invalid value of", key.p);
+
+            import_json_space(input, &position);
+            first = false;
+            if (position < input->size && input->p[position] == ',') { position++; continue; }
+            if (position < input->size && input->p[position] == '}') break;
+            import_error(line, "expected ',' or '}'", NULL);
+        }
+        position++;
+        import_json_space(input, &position);
+        if (position < input->size && input->p[position] != '\n') import_error(line, "text after object", NULL);
+        position++;
+        if (!found[0]) import_error(line, "missing description", NULL);
+        const bool priority_explicit = found[1] && !(found[3] && strcmp(values[3].p, "false") == 0);
+        import_record(records, line, &values[0], priority_explicit ? values[1].p : NULL, found[2] ? values[2].p : NULL, 0);
+    }
+    free(key.p);
+    for (size_t i = 0; i < 4; i++) free(values[i].p);
+    free(scratch.p);
+}
+
+void import_read(struct EntryBuffer *records, void *file, enum Input input)
+{
+    //Validate everything before TODO.md is touched
+    struct CharBuffer content = { 0 };
+    string_append_stream(&content, file);
+    if (input == INP_LINES) import_lines(records, &content);
+    else if (input == INP_CSV) import_csv(records, &content);
+    else import_json(records, &content);
+    free(content.p);
+}
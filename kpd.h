@@ -3,9 +3,11 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #define VERSION "0.1.0"
 #define TARGET "TODO.md"
+#define ARCHIVE "TODO.archive.md"
 #define INITIAL_BUFFER_SIZE 127
 
 typedef int (Command)(int argc, char **argv);
@@ -18,17 +20,22 @@ enum Error
     //User error
     ERR_USAGE = 10,
     ERR_FORMAT = 11,
+    ERR_CONFLICT = 12,
 
     //File operations
     ERR_SEEK = 20,
     ERR_TRUNCATE = 21,
     ERR_TELL = 22,
+    ERR_DUP = 23,
+    ERR_READ = 24,
+    ERR_TERMINAL = 25,
 
     //Filesystem
     ERR_PATH = 30,
     ERR_NOT_FOUND = 31,
     ERR_NOT_FILE = 32,
     ERR_NOT_DIRECTORY = 33,
+    ERR_WATCH = 34,
 
     //Memory
     ERR_MALLOC = 40,
@@ -39,11 +46,20 @@ enum Error
     ERR_EXEC = 51,
     ERR_WAIT = 52,
     ERR_GIT = 53,
+    ERR_PIPE = 54,
 
     //Other
     ERR_NOT_IMPLEMENTED = 60
 };
 
+///Source of TODO.md
+enum Source
+{
+    SRC_FILE,
+    SRC_STDIN,
+    SRC_MEMORY
+};
+
 ///Action to be performed on after "find" command
 enum Action
 {
@@ -72,14 +88,48 @@ enum Priority
     PRI_CRITICAL
 };
 
+///Output format of "list", "sort" and "next" commands
+enum Format
+{
+    FMT_TEXT,
+    FMT_JSON,
+    FMT_NDJSON,
+    FMT_TSV
+};
+
+///Input format of "import" command
+enum Input
+{
+    INP_LINES,
+    INP_CSV,
+    INP_NDJSON
+};
+
 ///Entry aka task
 struct Entry
 {
     size_t number;          ///< Entry number, zero-based
+    size_t offset;          ///< Position of entry in opaque lines of its buffer
     char *description;      ///< Plain text description
     enum Priority priority; ///< Priority
     bool priority_explicit; ///< Indicator if priority was given explicitly
     bool done;              ///< Task is done
+    unsigned int due;       ///< Due date as day number, see due.c, 0 for none
+    bool archived;          ///< Task is from TODO.archive.md, number counts archived tasks only
+};
+
+///Flags of entry packed into one byte, see struct EntryStore
+#define FLAG_PRIORITY 0x03 ///< Bits of enum Priority
+#define FLAG_EXPLICIT 0x04 ///< Priority was given explicitly
+#define FLAG_DONE     0x08 ///< Task is done
+#define FLAG_ARCHIVED 0x10 ///< Task is from TODO.archive.md
+
+///Vector of chars, size indicates the logical size, capacity indicates the allocated size (including null)
+struct CharBuffer
+{
+    char *p;
+    size_t size;
+    size_t capacity;
 };
 
 ///Vector of entries
@@ -88,34 +138,188 @@ struct EntryBuffer
     struct Entry *p;
     size_t size;
     size_t capacity;
+    struct CharBuffer opaque; ///< Lines that are not tasks (headings, text), written back verbatim
+    size_t first;             ///< Tasks before section, numbers in dependency markers count them too
 };
 
-///Vector of chars, size indicates the logical size, capacity indicates the allocated size (including null)
-struct CharBuffer
+///Dictionary of +project and @context tags in descriptions, every tag has bitset of entries with it
+struct TagIndex
 {
-    char *p;
+    struct CharBuffer names;    ///< Null-terminated lower case names with '+' or '@'
+    size_t *offsets;            ///< Offset of name of every tag in names
+    uint64_t **postings;        ///< Bitset of entries of every tag
+    size_t *words;              ///< Words of every bitset, entries past them do not have tag
+    size_t size;
+    size_t capacity;
+    size_t *slots;              ///< Tags by hash of name, SIZE_MAX for empty slot
+    size_t slots_capacity;      ///< Power of two, at least twice the number of tags
+};
+
+///Column-oriented vector of entries for read-only commands, numbers are indices
+struct EntryStore
+{
+    unsigned char *flags;       ///< Packed flags of entries, see FLAG_*
+    size_t *offsets;            ///< Offsets of null-terminated descriptions in blob
+    size_t size;
+    size_t capacity;
+    unsigned int *dues;         ///< Due dates of entries, see struct Entry
+    struct CharBuffer blob;     ///< Descriptions
+    struct TagIndex tags;       ///< Tags of descriptions, interned when entries are pushed
+    size_t first;               ///< Tasks before section, see struct EntryBuffer
+    size_t archived;            ///< First entry from TODO.archive.md, see FLAG_ARCHIVED
+};
+
+///Index of entries by hash of description, resolves short IDs
+struct IdIndex
+{
+    uint64_t *hashes;   ///< Hash of description of every entry
+    size_t *next;       ///< Next entry in same bucket, SIZE_MAX for last
+    size_t *heads;      ///< First entry of every bucket, entries of bucket share first digits of hash
+    size_t size;
+    size_t buckets;     ///< Power of two, at most one for every value of first four digits
+};
+
+///Beginning of dependency marker in description
+#define GRAPH_MARKER "(after:"
+///Beginning of due date marker in description, followed by YYYY-MM-DD)
+#define DUE_MARKER "(due: "
+
+///Min-heap of open entries with due dates, earliest first, then by priority
+struct DueHeap
+{
+    size_t *p;                      ///< Indices of entries in store
+    size_t size;
+    const struct EntryStore *store; ///< Store of entries
+};
+
+///Dependencies declared by (after: <number>, ...) markers, edges lead from prerequisite to dependent entry
+struct Graph
+{
+    size_t *heads;          ///< First edge from every entry, SIZE_MAX for none
+    size_t *sources;        ///< Prerequisite of every edge, SIZE_MAX if reference matches no entry
+    size_t *targets;        ///< Dependent entry of every edge
+    size_t *next;           ///< Next edge from same prerequisite, SIZE_MAX for last
+    size_t edges;
+    size_t edges_capacity;
+    size_t *degrees;        ///< Open prerequisites of every entry, entry is blocked while not zero
+    unsigned char *flags;   ///< Flags of every entry, see FLAG_*
+    uint64_t *ready;        ///< Bitsets of open entries that are not blocked, one for every priority
+    size_t words;           ///< Words of every bitset
+    size_t size;
+};
+
+///Problem found in raw contents of TODO.md
+struct Problem
+{
+    size_t line;            ///< Line number, from 1
+    size_t column;          ///< Column in bytes, from 1
+    bool fixable;           ///< Indicator if kpd test --fix fixes it
+    char message[64];       ///< Message like in output of kpd test
+};
+
+///Vector of problems
+struct ProblemBuffer
+{
+    struct Problem *p;
+    size_t size;
+    size_t capacity;
+};
+
+///Instruction of compiled query, see query.c
+struct QueryInstruction
+{
+    unsigned char opcode;   ///< Operation
+    unsigned char flags;    ///< Set of flag combinations, bit (done ? 4 : 0) | priority, or if every match needs tag
+    size_t argument;        ///< Offset of string or target of jump
+};
+
+///Filter expression compiled to flat program
+struct Query
+{
+    struct QueryInstruction *p;
     size_t size;
     size_t capacity;
+    struct CharBuffer strings;  ///< Lower case strings of description and tag tests, null-terminated
+    unsigned char flags;        ///< Flag combinations that can match at all, exact unless text is set
+    bool text;                  ///< Program tests descriptions
+    bool tags;                  ///< Program tests tags
+    bool status;                ///< Expression mentions done state
 };
 
+///Sets of flag combinations in struct Query
+#define QUERY_ALL  0xFF ///< All tasks
+#define QUERY_OPEN 0x0F ///< Open tasks of any priority
+#define QUERY_DONE 0xF0 ///< Done tasks of any priority
+
 //common.c
+///Keywords indexed by enum Action, enum Status, enum Priority, enum Format and enum Input
+extern const char *const kpd_action_strings[6];
+extern const char *const kpd_status_strings[3];
+extern const char *const kpd_priority_strings[4];
+extern const char *const kpd_format_strings[4];
+extern const char *const kpd_input_strings[3];
 ///Prints error message and exits
 void kpd_error(enum Error error, const char *format, ...) __attribute__((noreturn)) __attribute__ ((format (printf, 2, 3)));
-///Reads entries from TODO.md into buffer, returns open FILE* (buffer may be NULL)
+///Parses line into entry, returns false for lines that are not tasks (otherwise line is modified and holds description)
+bool kpd_read_line(struct Entry *entry, struct CharBuffer *line);
+///Sets source of TODO.md, SRC_STDIN makes kpd_write_target write to stdout and redirects other output to stderr
+///SRC_MEMORY makes kpd_read_target copy entries (read-only commands only)
+void kpd_set_source(enum Source source, const struct EntryBuffer *entries);
+///Returns source of TODO.md
+enum Source kpd_get_source(void);
+///Restricts kpd_read_target and kpd_write_target to lines under heading (NULL for whole file)
+void kpd_set_section(const char *section);
+///Returns section name
+const char *kpd_get_section(void);
+///Searches for TODO.md in current directory and its parents, sets relative path
+void kpd_find_target(struct CharBuffer *path);
+///Reads entries from TODO.md into buffer, returns open FILE* (buffer may be NULL, path must be NULL for SRC_STDIN)
 void kpd_read_target(void *file, struct EntryBuffer *entries, struct CharBuffer *path);
-///Writes entries to the open FILE*
+///Reads entries from TODO.md into store
+void kpd_read_store(struct EntryStore *store);
+///Counts entries of TODO.md by done and enum Priority, without parsing whole file if possible
+void kpd_read_counts(size_t counts[2][4]);
+///Reads whole TODO.md as it is into content, returns open FILE* (file may be NULL, path must be NULL for SRC_STDIN)
+void kpd_read_raw(void *file, struct CharBuffer *content, struct CharBuffer *path);
+///Reads limit entries matching query after offset (in sorted order if sorted), parses only those if possible
+void kpd_read_page(struct EntryBuffer *entries, const struct Query *query, bool sorted, size_t offset, size_t limit);
+///Replaces TODO.md at end of path with TODO.archive.md
+void kpd_archive_path(struct CharBuffer *path);
+///Appends archived entries to store (only if whole TODO.md is read from file)
+void kpd_read_archive(struct EntryStore *store);
+///Reads entries from whole file at path, ignoring section, returns false if file cannot be opened
+bool kpd_read_path(struct EntryBuffer *entries, const char *path);
+///Replaces entries of section with entries of whole TODO.md and widens mask to them, kpd_write_target then writes whole TODO.md
+void kpd_read_whole(void *file, struct EntryBuffer *entries, char **mask);
+///Writes entry as task line to FILE*
+void kpd_write_entry(void *file, const struct Entry *entry);
+///Writes entries to the open FILE* unless it already has them
 void kpd_write_target(void *file, const struct EntryBuffer *entries);
+///Writes raw contents to the open FILE* unless it already has them (current holds what kpd_read_raw read)
+void kpd_write_raw(void *file, const struct CharBuffer *current, const char *p, size_t size);
+///Appends entries in mask to TODO.archive.md next to TODO.md at path
+void kpd_write_archive(const char *path, const struct EntryBuffer *entries, const char *mask);
 ///Prints entry to stdout (max_length/max_marker_length are zero for no spaces)
 void kpd_print_entry(const struct Entry *entry, unsigned int max_length, unsigned int max_marker_length);
 ///Prints entries to stdout (if mask is NULL, prints all)
 void kpd_print_entries(const struct EntryBuffer *entries, const char *mask);
-///Parses number and sets mask (if mask is NULL, only checks format)
-bool kpd_parse_number(char *mask, size_t mask_size, const char *number_string);
+///Prints entries to stdout in given format (if mask is NULL, prints all)
+void kpd_format_entries(const struct EntryBuffer *entries, const char *mask, enum Format format);
+///Removes option and its value (if value is not NULL) from arguments, returns if option was found
+bool kpd_parse_option(int *argc, char **argv, const char *option, const char **value);
+///Removes option and its non-negative integer value from arguments, returns if option was found
+bool kpd_parse_size(int *argc, char **argv, const char *option, size_t *value);
+///Removes '--format <format>' from arguments and returns format
+enum Format kpd_parse_format(int *argc, char **argv);
+///Parses numbers, ranges and @IDs and sets mask of entries (if mask is NULL, only checks format)
+bool kpd_parse_number(char *mask, const struct EntryBuffer *entries, const char *number_string);
 ///Sets mask based on parsed number
-char *kpd_create_mask(size_t mask_size, const char *number_string);
-///Sets mask based on open entry with highest priority
+char *kpd_create_mask(const struct EntryBuffer *entries, const char *number_string);
+///Makes commands select entries matching query instead of their default entry (NULL for default entry)
+void kpd_set_query(const struct Query *query);
+///Sets mask based on open entry with highest priority, or on query
 char *kpd_create_mask_highest_open(const struct EntryBuffer *entries);
-///Sets mask based on last done entry
+///Sets mask based on last done entry, or on query
 char *kpd_create_mask_last_closed(const struct EntryBuffer *entries);
 ///Parses action string (if action is NULL, only checks)
 bool kpd_resolve_action(enum Action *action, const char *action_string);
@@ -123,20 +327,140 @@ bool kpd_resolve_action(enum Action *action, const char *action_string);
 bool kpd_resolve_status(enum Status *status, const char *status_string);
 ///Parses priority string (if priority is NULL, only checks)
 bool kpd_resolve_priority(enum Priority *priority, const char *priority_string);
+///Parses format string (if format is NULL, only checks)
+bool kpd_resolve_format(enum Format *format, const char *format_string);
+///Parses input format string
+bool kpd_resolve_input(enum Input *input, const char *input_string);
 ///Returns if string can be resolved as 'commit'
 bool kpd_resolve_commit(const char *commit_string);
+///Invokes 'git add'
+void kpd_invoke_git_add(const char *path);
 ///Invokes git
 void kpd_invoke_git(const char *path, const char *commit_message);
+///Runs git with arguments, returns FILE* reading its output
+void *kpd_open_git(char *const *arguments, int *id);
+///Runs git with arguments, returns FILE* reading its output and sets input to FILE* writing its input (close input first)
+void *kpd_open_git_batch(char *const *arguments, void *input, int *id);
+///Closes output of git and waits for it
+void kpd_close_git(void *file, int id);
+///Sets times of last change of tasks in TODO.md from 'git blame' (only whole TODO.md)
+void kpd_read_times(long *times, size_t size, const char *path);
+
+//complete.c
+///Prints candidates for the last of words (words start with program name), one per line, numbers followed by '\t' and description
+int complete_run(int argc, char **argv, const char *const *commands, size_t commands_size);
+///Prints completion script for shell
+int complete_script(const char *shell);
+
+//count.c
+///Finds next task line in raw contents of TODO.md and its flags without parsing it, returns end of line (NULL if none)
+const char *count_task(unsigned char *flags, const char **line, const char *p, const char *end);
+///Adds entries in raw contents of TODO.md to counts by done and enum Priority
+void count_scan(size_t counts[2][4], const char *p, size_t size);
+
+//due.c
+///Returns day number of date in form YYYY-MM-DD (first 10 chars), 0 if invalid
+unsigned int due_parse(const char *date);
+///Sets date to form YYYY-MM-DD of day number (date must hold 11 chars)
+void due_format(char *date, unsigned int due);
+///Returns day number of today in local time
+unsigned int due_today(void);
+///Builds heap of open entries of store with due dates in linear time
+void due_heap(struct DueHeap *heap, const struct EntryStore *store);
+///Removes earliest entry from heap, returns false if heap is empty
+bool due_pop(size_t *index, struct DueHeap *heap);
+///Destroys heap
+void due_finalize(struct DueHeap *heap);
 
 //entries.c
 ///Sets buffer size
 void entries_set_size(struct EntryBuffer *entries, size_t size);
-///Destroys buffer
+///Destroys buffer (free_descriptions also frees opaque lines)
 void entries_finalize(struct EntryBuffer *entries, bool free_descriptions);
-///Finds open entry with highest priority
-bool entries_highest_open(size_t *index, const struct EntryBuffer *entries);
-///Sorts entries by priority, critical first
-void entries_sort(const struct EntryBuffer *entries);
+///Sets mask to duplicates of earlier entries and merges them into those, kept to entry each duplicate is merged into
+///(SIZE_MAX for others), returns number of duplicates
+size_t entries_dedupe(char *mask, size_t *kept, struct EntryBuffer *entries);
+
+//lsp.c
+///Serves language server protocol on standard input and output until exit notification, returns exit code
+int lsp_run(void);
+
+//merge.c
+///Writes three-way merge of entries to FILE*, entries are matched by description, returns number of conflicts
+size_t merge_write(void *file, const struct EntryBuffer *base, const struct EntryBuffer *ours, const struct EntryBuffer *theirs);
+
+//pick.c
+///Lets user pick entries among those set in mask on terminal, sets mask to picked entries and returns their number (0 if cancelled)
+size_t pick_run(char *mask, const struct EntryStore *store);
+
+//query.c
+///Compiles expression joined from arguments (open selects open tasks unless done state is mentioned), exits if invalid
+void query_compile(struct Query *query, int argc, char **argv, bool open);
+///Returns if entry with flags and description matches query
+bool query_match(const struct Query *query, unsigned char flags, const char *description);
+///Sets mask to entries matching query, returns their number
+size_t query_select(char *mask, const struct Query *query, const struct EntryBuffer *entries);
+///Sets mask to store entries matching query, returns their number
+size_t query_select_store(char *mask, const struct Query *query, const struct EntryStore *store);
+///Destroys query
+void query_finalize(struct Query *query);
+
+//store.c
+///Appends entry to store, copies description
+void store_push(struct EntryStore *store, const struct Entry *entry);
+///Destroys store
+void store_finalize(struct EntryStore *store);
+///Sets mask to entries with (flags & flags_mask) == flags_value
+void store_select(char *mask, const struct EntryStore *store, unsigned char flags_mask, unsigned char flags_value);
+///Sets order to indices of entries sorted by priority, critical first
+void store_sort(size_t *order, const struct EntryStore *store);
+///Sets entries to views of store entries in order (NULL for natural) and in mask (NULL for all), finalize without descriptions
+void store_view(struct EntryBuffer *entries, const struct EntryStore *store, const size_t *order, const char *mask);
+
+//graph.c
+///Builds dependencies of entries in one pass
+void graph_build(struct Graph *graph, const struct EntryBuffer *entries);
+///Builds dependencies of store entries in one pass
+void graph_build_store(struct Graph *graph, const struct EntryStore *store);
+///Returns if entry is open and has open prerequisites
+bool graph_blocked(const struct Graph *graph, size_t entry);
+///Removes blocked entries from mask
+void graph_unblocked(char *mask, const struct Graph *graph);
+///Finds open entry with highest priority that is not blocked
+bool graph_next(size_t *index, const struct Graph *graph);
+///Marks entry as done or open, sets changed to dependents it blocked or unblocked, returns their number
+size_t graph_set_done(char *changed, struct Graph *graph, size_t entry, bool done);
+///Rewrites references of entries not in mask as if entries in mask were removed, references to them are dropped,
+///or point to entry in redirect instead (NULL or SIZE_MAX for none)
+void graph_renumber(struct EntryBuffer *entries, const char *mask, const size_t *redirect);
+///Sets mask to entries on dependency cycles, returns their number
+size_t graph_cycles(char *mask, const struct Graph *graph);
+///Destroys graph
+void graph_finalize(struct Graph *graph);
+
+//history.c
+///Prints timeline of every task from 'git log' of TODO.md at path (since is passed to git, NULL for whole history)
+void history_log(const char *path, const char *since);
+///Prints numbers of open and done tasks at end of every day with commits of TODO.md at path
+void history_counts(const char *path);
+
+//id.c
+///Indexes entries by hash of description
+void id_index(struct IdIndex *index, const struct EntryBuffer *entries);
+///Sets mask to entries with ID starting with lowercase hexadecimal digits, returns if any found (exits if ambiguous)
+bool id_find(char *mask, const struct IdIndex *index, const char *id, size_t id_length);
+///Returns first entry with ID starting with lowercase hexadecimal digits, SIZE_MAX if none or ambiguous
+size_t id_lookup(const struct IdIndex *index, const char *id, size_t id_length);
+///Returns if ID of description starts with lowercase hexadecimal digits, without index
+bool id_match(const char *description, const char *id, size_t id_length);
+///Sets id to shortest unique ID of entry, at least 4 and at most 16 digits (id must hold 17 chars)
+void id_format(char *id, const struct IdIndex *index, size_t number);
+///Destroys index
+void id_finalize(struct IdIndex *index);
+
+//import.c
+///Reads and validates all records of file, appends them to records (exits on first invalid record)
+void import_read(struct EntryBuffer *records, void *file, enum Input input);
 
 //string.c
 ///Sets string size, size does not include '\0'
@@ -145,6 +469,10 @@ void string_set_size(struct CharBuffer *string, size_t size);
 bool string_set_line(struct CharBuffer *string, void *file);
 ///Sets string to user input
 void string_set_input(struct CharBuffer *string, const char *prompt, const char *prefill, const char *prefill_prompt);
+///Appends rest of file to string
+void string_append_stream(struct CharBuffer *string, void *file);
+///Sets string to contents of file, returns whether file could be opened
+bool string_set_file(struct CharBuffer *string, const char *path);
 ///Sets string to current working directory
 void string_set_cwd(struct CharBuffer *path);
 ///Destroys buffer
@@ -157,6 +485,10 @@ void string_append_file(struct CharBuffer *path);
 bool string_remove_file(struct CharBuffer *path);
 ///Removes trailing and leading spaces from string
 void string_trim(struct CharBuffer *string, size_t beginning_spaces, size_t ending_spaces);
+///Sets string to description folded for comparison (case, whitespace, trailing punctuation)
+void string_normalize(struct CharBuffer *string, const char *description);
+///Returns hash of bytes
+uint64_t string_hash(const char *p, size_t size);
 ///Transforms description to commit message
 void string_description_to_done_commit(struct CharBuffer *string);
 ///Transforms description to commit message
@@ -166,4 +498,30 @@ void string_description_to_remove_commit(struct CharBuffer *string);
 ///Resolves string
 bool string_resolve(size_t *index, const char *option, const char *const *options, size_t options_size);
 
+//validate.c
+///Prints problems in raw contents of TODO.md as name:line:column (report NULL for none), writes fixed contents to FILE* fix (NULL for none), sets counts to problems found and fixed
+void validate_scan(size_t counts[2], void *report, const char *name, const char *p, size_t size, void *fix);
+///Appends problems of lines in raw contents of TODO.md, first numbered line (crlf is line end of first line of file, -1 if unknown)
+void validate_lines(struct ProblemBuffer *problems, const char *p, size_t size, size_t line, int crlf);
+///Appends references that match no task and dependency cycles in raw contents of TODO.md
+void validate_dependencies(struct ProblemBuffer *problems, const char *p, size_t size);
+///Prints problems in TODO.md at path in every revision (empty for index) from one 'git cat-file', adds to counts of problems
+void validate_revisions(size_t counts[2], const char *path, char *const *revisions, size_t revisions_size);
+
+//tag.c
+///Interns +project and @context tags of description and adds entry to their bitsets, @ID and dependency markers are no tags
+void tag_push(struct TagIndex *index, const char *description, size_t entry);
+///Finds tag by lower case name with '+' or '@', returns SIZE_MAX if no entry has it
+size_t tag_find(const struct TagIndex *index, const char *name);
+///Returns if description has tag with lower case name
+bool tag_contains(const char *description, const char *name);
+///Returns if whole string is a tag
+bool tag_valid(const char *name);
+///Destroys index
+void tag_finalize(struct TagIndex *index);
+
+//watch.c
+///Runs read-only command on every change of TODO.md, redraws changed rows only
+int watch_run(Command *command, int argc, char **argv);
+
 #endif
@@ -0,0 +1,691 @@
+#include "kpd.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+///Text document opened by editor, lines and problems follow every change
+struct Document
+{
+    struct CharBuffer uri;          ///< URI given by editor
+    struct CharBuffer text;         ///< Contents
+    size_t *lines;                  ///< Offsets of line beginnings in text, text ending with line end has empty last line
+    size_t lines_size;              ///< Number of lines, at least one
+    size_t lines_capacity;          ///< Allocated size of lines
+    struct ProblemBuffer problems;  ///< Problems of lines, sorted by line
+};
+
+///State of language server
+struct Server
+{
+    struct Document *documents;     ///< Open documents
+    size_t size;                    ///< Number of open documents
+    size_t capacity;                ///< Allocated size of documents
+    struct CharBuffer message;      ///< Contents of message being handled
+    struct CharBuffer output;       ///< Contents of message being sent
+    struct CharBuffer scratch;      ///< Decoded strings
+};
+
+//Needed by lsp_run
+static size_t lsp_space(const char *json, size_t size, size_t i)
+{
+    while (i < size && (json[i] == ' ' || json[i] == '\t' || json[i] == '\r' || json[i] == '\n')) i++;
+    return i;
+}
+
+static size_t lsp_skip(const char *json, size_t size, size_t i)
+{
+    //Returns end of value at i, SIZE_MAX if invalid
+    i = lsp_space(json, size, i);
+    if (i == size) return SIZE_MAX;
+    if (json[i] == '"')
+    {
+        for (i++; i < size && json[i] != '"'; i++)
+        {
+            if (json[i] == '\\') i++;
+        }
+        return (i < size) ? (i + 1) : SIZE_MAX;
+    }
+    if (json[i] == '{' || json[i] == '[')
+    {
+        const char close = (json[i] == '{') ? '}' : ']';
+        i = lsp_space(json, size, i + 1);
+        if (i < size && json[i] == close) return i + 1;
+        while (i < size)
+        {
+            if (close == '}')
+            {
+                i = lsp_skip(json, size, i);
+                if (i == SIZE_MAX || (i = lsp_space(json, size, i)) == size || json[i] != ':') return SIZE_MAX;
+                i++;
+            }
+            i = lsp_skip(json, size, i);
+            if (i == SIZE_MAX || (i = lsp_space(json, size, i)) == size) return SIZE_MAX;
+            if (json[i] == close) return i + 1;
+            if (json[i] != ',') return SIZE_MAX;
+            i++;
+        }
+        return SIZE_MAX;
+    }
+    const size_t begin = i;
+    while (i < size && strchr("-+.0123456789eEtrufalsn", json[i]) != NULL && json[i] != '\0') i++;
+    return (i > begin) ? i : SIZE_MAX;
+}
+
+static size_t lsp_member(const char *json, size_t size, size_t i, const char *key)
+{
+    //Returns beginning of value of key in object at i, SIZE_MAX if none, keys of protocol need no unescaping
+    if (i == SIZE_MAX || (i = lsp_space(json, size, i)) == size || json[i] != '{') return SIZE_MAX;
+    const size_t key_length = strlen(key);
+    i = lsp_space(json, size, i + 1);
+    while (i < size && json[i] == '"')
+    {
+        const size_t key_end = lsp_skip(json, size, i);
+        if (key_end == SIZE_MAX) return SIZE_MAX;
+        const bool found = key_end - i - 2 == key_length && memcmp(json + i + 1, key, key_length) == 0;
+        i = lsp_space(json, size, key_end);
+        if (i == size || json[i] != ':') return SIZE_MAX;
+        i = lsp_space(json, size, i + 1);
+        if (found) return i;
+        i = lsp_skip(json, size, i);
+        if (i == SIZE_MAX || (i = lsp_space(json, size, i)) == size || json[i] != ',') return SIZE_MAX;
+        i = lsp_space(json, size, i + 1);
+    }
+    return SIZE_MAX;
+}
+
+static size_t lsp_find(const struct CharBuffer *message, const char *const *path)
+{
+    //Path of keys ends with NULL
+    size_t i = 0;
+    for (; *path != NULL && i != SIZE_MAX; path++) i = lsp_member(message->p, message->size, i, *path);
+    return i;
+}
+
+static size_t lsp_number(const struct CharBuffer *message, size_t i)
+{
+    //Non-negative integers only, SIZE_MAX if none
+    if (i == SIZE_MAX || i == message->size || message->p[i] < '0' || message->p[i] > '9') return SIZE_MAX;
+    size_t number = 0;
+    for (; i < message->size && message->p[i] >= '0' && message->p[i] <= '9'; i++) number = 10 * number + (size_t)(message->p[i] - '0');
+    return number;
+}
+
+static bool lsp_string(struct CharBuffer *string, const struct CharBuffer *message, size_t i)
+{
+    string_set_size(string, 0);
+    if (i == SIZE_MAX || i == message->size || message->p[i] != '"') return false;
+    const char *json = message->p;
+    for (i++; i < message->size && json[i] != '"';)
+    {
+        //Copy unescaped run
+        const size_t begin = i;
+        while (i < message->size && json[i] != '"' && json[i] != '\\') i++;
+        string_substitute(string, string->size, 0, json + begin, i - begin);
+        if (i == message->size || json[i] == '"') break;
+
+        //Escape, surrogate pairs are joined
+        if (++i == message->size) return false;
+        const char *escapes = "\"\\/bfnrt";
+        const char *replacements = "\"\\/\b\f\n\r\t";
+        const char *escape = (json[i] == '\0') ? NULL : strchr(escapes, json[i]);
+        if (escape != NULL)
+        {
+            string_substitute(string, string->size, 0, replacements + (escape - escapes), 1);
+            i++;
+            continue;
+        }
+        uint32_t code = 0;
+        for (size_t k = 0; k < 2; k++)
+        {
+            if (json[i] != 'u' || i + 5 > message->size) return false;
+            char digits[5] = { json[i + 1], json[i + 2], json[i + 3], json[i + 4], '\0' };
+            char *digits_end;
+            const uint32_t unit = (uint32_t)strtoul(digits, &digits_end, 16);
+            if (digits_end != digits + 4) return false;
+            i += 5;
+            code = (k == 0) ? unit : (0x10000 + ((code - 0xD800) << 10) + (unit - 0xDC00));
+            if (k == 1 || code < 0xD800 || code >= 0xDC00 || i + 1 >= message->size || json[i] != '\\' || json[i + 1] != 'u') break;
+            i++;
+        }
+        char bytes[4];
+        size_t bytes_size;
+        if (code < 0x80) { bytes[0] = (char)code; bytes_size = 1; }
+        else if (code < 0x800) { bytes[0] = (char)(0xC0 | (code >> 6)); bytes[1] = (char)(0x80 | (code & 0x3F)); bytes_size = 2; }
+        else if (code < 0x10000) { bytes[0] = (char)(0xE0 | (code >> 12)); bytes[1] = (char)(0x80 | ((code >> 6) & 0x3F)); bytes[2] = (char)(0x80 | (code & 0x3F)); bytes_size = 3; }
+        else { bytes[0] = (char)(0xF0 | (code >> 18)); bytes[1] = (char)(0x80 | ((code >> 12) & 0x3F)); bytes[2] = (char)(0x80 | ((code >> 6) & 0x3F)); bytes[3] = (char)(0x80 | (code & 0x3F)); bytes_size = 4; }
+        string_substitute(string, string->size, 0, bytes, bytes_size);
+    }
+    return i < message->size;
+}
+
+static void lsp_append(struct CharBuffer *output, const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+static void lsp_append(struct CharBuffer *output, const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    char small[256];
+    const int length = vsnprintf(small, sizeof(small), format, va);
+    va_end(va);
+    if (length < 0) kpd_error(ERR_MALLOC, "vsnprintf() failed");
+    const size_t begin = output->size;
+    string_set_size(output, begin + (size_t)length);
+    if ((size_t)length < sizeof(small))
+    {
+        memcpy(output->p + begin, small, (size_t)length);
+        return;
+    }
+    va_start(va, format);
+    vsnprintf(output->p + begin, (size_t)length + 1, format, va);
+    va_end(va);
+}
+
+static void lsp_append_string(struct CharBuffer *output, const char *p, size_t size)
+{
+    //Copies runs of plain bytes at once, escapes the rest
+    string_substitute(output, output->size, 0, "\"", 1);
+    const char *run = p;
+    for (const char *c = p; c < p + size; c++)
+    {
+        const unsigned char u = (unsigned char)*c;
+        if (u >= 0x20 && u != '"' && u != '\\') continue;
+        string_substitute(output, output->size, 0, run, (size_t)(c - run));
+        if (u == '"') lsp_append(output, "\\\"");
+        else if (u == '\\') lsp_append(output, "\\\\");
+        else if (u == '\n') lsp_append(output, "\\n");
+        else if (u == '\r') lsp_append(output, "\\r");
+        else if (u == '\t') lsp_append(output, "\\t");
+        else lsp_append(output, "\\u%04x", (unsigned int)u);
+        run = c + 1;
+    }
+    string_substitute(output, output->size, 0, run, (size_t)(p + size - run));
+    string_substitute(output, output->size, 0, "\"", 1);
+}
+
+static void lsp_send(struct CharBuffer *output)
+{
+    //Header and contents at once
+    printf("Content-Length: %u\r\n\r\n", (unsigned int)output->size);
+    fwrite(output->p, 1, output->size, stdout);
+    if (fflush(stdout) != 0) kpd_error(ERR_PIPE, "fflush() failed");
+    string_set_size(output, 0);
+}
+
+static void lsp_respond(struct Server *server, size_t id, const char *key)
+{
+    //Begins response with same ID as request, caller appends result or error and closes object
+    string_set_size(&server->output, 0);
+    lsp_append(&server->output, "{\"jsonrpc\":\"2.0\",\"id\":");
+    const size_t id_end = (id == SIZE_MAX) ? SIZE_MAX : lsp_skip(server->message.p, server->message.size, id);
+    if (id_end == SIZE_MAX) lsp_append(&server->output, "null");
+    else string_substitute(&server->output, server->output.size, 0, server->message.p + id, id_end - id);
+    lsp_append(&server->output, ",\"%s\":", key);
+}
+
+static size_t lsp_line_end(const struct Document *document, size_t line)
+{
+    //End of line contents without line end
+    size_t end = (line + 1 < document->lines_size) ? (document->lines[line + 1] - 1) : document->text.size;
+    if (line + 1 < document->lines_size && end > document->lines[line] && document->text.p[end - 1] == '\r') end--;
+    return end;
+}
+
+static size_t lsp_offset(const struct Document *document, size_t line, size_t character)
+{
+    //Character counts UTF-16 code units, positions past line end are clamped
+    if (line >= document->lines_size) return document->text.size;
+    const size_t end = lsp_line_end(document, line);
+    size_t offset = document->lines[line];
+    for (size_t units = 0; offset < end && units < character; )
+    {
+        const unsigned char c = (unsigned char)document->text.p[offset];
+        units += (c >= 0xF0) ? 2 : 1;
+        offset++;
+        while (offset < end && ((unsigned char)document->text.p[offset] & 0xC0) == 0x80) offset++;
+    }
+    return offset;
+}
+
+static size_t lsp_character(const struct Document *document, size_t line, size_t offset)
+{
+    size_t units = 0;
+    for (size_t i = document->lines[line]; i < offset; i++)
+    {
+        const unsigned char c = (unsigned char)document->text.p[i];
+        if ((c & 0xC0) != 0x80) units += (c >= 0xF0) ? 2 : 1;
+    }
+    return units;
+}
+
+static int lsp_crlf(const struct Document *document)
+{
+    //Line end of first line like in validator, -1 without line end
+    if (document->lines_size < 2) return -1;
+    const size_t endline = document->lines[1] - 1;
+    return (endline > 0 && document->text.p[endline - 1] == '\r') ? 1 : 0;
+}
+
+static void lsp_validate(struct Document *document, size_t first, size_t last)
+{
+    //Problems of lines [first, last) replace their old problems, which are already removed
+    struct ProblemBuffer problems = { 0 };
+    const size_t begin = document->lines[first];
+    const size_t end = (last < document->lines_size) ? document->lines[last] : document->text.size;
+    validate_lines(&problems, document->text.p + begin, end - begin, first + 1, lsp_crlf(document));
+    size_t position = 0;
+    while (position < document->problems.size && document->problems.p[position].line <= first) position++;
+    struct ProblemBuffer *all = &document->problems;
+    if (all->size + problems.size > all->capacity)
+    {
+        while (all->size + problems.size > all->capacity) all->capacity = (all->capacity == 0) ? 16 : (2 * all->capacity);
+        struct Problem *new_p = realloc(all->p, all->capacity * sizeof(*all->p));
+        if (new_p == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        all->p = new_p;
+    }
+    if (problems.size > 0)
+    {
+        memmove(all->p + position + problems.size, all->p + position, (all->size - position) * sizeof(*all->p));
+        memcpy(all->p + position, problems.p, problems.size * sizeof(*all->p));
+        all->size += problems.size;
+    }
+    free(problems.p);
+}
+
+static void lsp_set_text(struct Document *document, const char *text, size_t size)
+{
+    //Whole document is split and validated again
+    string_set_size(&document->text, 0);
+    string_substitute(&document->text, 0, 0, text, size);
+    document->lines_size = 0;
+    for (size_t offset = 0; true; )
+    {
+        if (document->lines_size == document->lines_capacity)
+        {
+            document->lines_capacity = (document->lines_capacity == 0) ? 16 : (2 * document->lines_capacity);
+            size_t *new_lines = realloc(document->lines, document->lines_capacity * sizeof(*document->lines));
+            if (new_lines == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+            document->lines = new_lines;
+        }
+        document->lines[document->lines_size++] = offset;
+        const char *endline = memchr(document->text.p + offset, '\n', size - offset);
+        if (endline == NULL) break;
+        offset = (size_t)(endline - document->text.p) + 1;
+    }
+    document->problems.size = 0;
+    lsp_validate(document, 0, document->lines_size);
+}
+
+static void lsp_edit(struct Document *document, size_t first_line, size_t first_character, size_t last_line, size_t last_character, const char *text, size_t size)
+{
+    //Replace text of range
+    const size_t begin = lsp_offset(document, first_line, first_character);
+    const size_t end = lsp_offset(document, last_line, last_character);
+    if (end < begin) return;
+    const int crlf = lsp_crlf(document);
+    const size_t first = (first_line < document->lines_size) ? first_line : (document->lines_size - 1);
+    const size_t last = (last_line < document->lines_size) ? last_line : (document->lines_size - 1);
+    string_substitute(&document->text, begin, end - begin, text, size);
+
+    //Line beginnings of inserted text replace those of removed text, following ones are shifted
+    size_t inserted = 0;
+    for (const char *p = memchr(text, '\n', size); p != NULL; p = memchr(p + 1, '\n', size - (size_t)(p + 1 - text))) inserted++;
+    const size_t removed = last - first;
+    const size_t old_size = document->lines_size;
+    const size_t new_size = old_size - removed + inserted;
+    if (new_size > document->lines_capacity)
+    {
+        while (new_size > document->lines_capacity) document->lines_capacity *= 2;
+        size_t *new_lines = realloc(document->lines, document->lines_capacity * sizeof(*document->lines));
+        if (new_lines == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        document->lines = new_lines;
+    }
+    memmove(document->lines + first + 1 + inserted, document->lines + last + 1, (old_size - last - 1) * sizeof(*document->lines));
+    size_t line = first + 1;
+    for (const char *p = memchr(text, '\n', size); p != NULL; p = memchr(p + 1, '\n', size - (size_t)(p + 1 - text)))
+        document->lines[line++] = begin + (size_t)(p - text) + 1;
+    for (size_t i = first + 1 + inserted; i < new_size; i++) document->lines[i] = document->lines[i] - (end - begin) + size;
+    document->lines_size = new_size;
+
+    //Line end of first line applies to every line
+    if (lsp_crlf(document) != crlf)
+    {
+        document->problems.size = 0;
+        lsp_validate(document, 0, document->lines_size);
+        return;
+    }
+
+    //Problems of touched lines are found again, following ones are renumbered
+    struct ProblemBuffer *problems = &document->problems;
+    size_t kept = 0;
+    for (size_t i = 0; i < problems->size; i++)
+    {
+        struct Problem problem = problems->p[i];
+        if (problem.line > first && problem.line <= last + 1) continue;
+        if (problem.line > last + 1) problem.line = problem.line - removed + inserted;
+        problems->p[kept++] = problem;
+    }
+    problems->size = kept;
+    lsp_validate(document, first, first + inserted + 1);
+}
+
+static struct Document *lsp_document(struct Server *server, const struct CharBuffer *uri, bool create)
+{
+    for (struct Document *document = server->documents; document < server->documents + server->size; document++)
+    {
+        if (document->uri.size == uri->size && memcmp(document->uri.p, uri->p, uri->size) == 0) return document;
+    }
+    if (!create) return NULL;
+
+    //New document
+    if (server->size == server->capacity)
+    {
+        server->capacity = (server->capacity == 0) ? 4 : (2 * server->capacity);
+        struct Document *new_documents = realloc(server->documents, server->capacity * sizeof(*server->documents));
+        if (new_documents == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        server->documents = new_documents;
+    }
+    struct Document *document = &server->documents[server->size++];
+    memset(document, 0, sizeof(*document));
+    string_substitute(&document->uri, 0, 0, uri->p, uri->size);
+    return document;
+}
+
+static void lsp_close(struct Server *server, struct Document *document)
+{
+    free(document->uri.p);
+    free(document->text.p);
+    free(document->lines);
+    free(document->problems.p);
+    *document = server->documents[--server->size];
+}
+
+static void lsp_range(struct CharBuffer *output, size_t first_line, size_t first_character, size_t last_line, size_t last_character)
+{
+    lsp_append(output, "{\"start\":{\"line\":%u,\"character\":%u},\"end\":{\"line\":%u,\"character\":%u}}",
+        (unsigned int)first_line, (unsigned int)first_character, (unsigned int)last_line, (unsigned int)last_character);
+}
+
+static void lsp_publish(struct Server *server, const struct Document *document, const struct CharBuffer *uri)
+{
+    //Problems of lines, then dependencies which need whole document
+    struct CharBuffer *output = &server->output;
+    struct ProblemBuffer dependencies = { 0 };
+    if (document != NULL) validate_dependencies(&dependencies, document->text.p, document->text.size);
+    lsp_append(output, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    lsp_append_string(output, uri->p, uri->size);
+    lsp_append(output, ",\"diagnostics\":[");
+    const size_t lines_size = (document == NULL) ? 0 : document->problems.size;
+    for (size_t i = 0; i < lines_size + dependencies.size; i++)
+    {
+        const struct Problem *problem = (i < lines_size) ? &document->problems.p[i] : &dependencies.p[i - lines_size];
+        const size_t line = problem->line - 1;
+        const size_t end = lsp_line_end(document, line);
+        const size_t offset = document->lines[line] + problem->column - 1;
+        if (i > 0) lsp_append(output, ",");
+        lsp_append(output, "{\"range\":");
+        lsp_range(output, line, lsp_character(document, line, offset), line, lsp_character(document, line, (end > offset) ? end : offset));
+        lsp_append(output, ",\"severity\":%u,\"source\":\"kpd\",\"message\":", problem->fixable ? 2u : 1u);
+        lsp_append_string(output, problem->message, strlen(problem->message));
+        lsp_append(output, "}");
+    }
+    lsp_append(output, "]}}");
+    lsp_send(output);
+    free(dependencies.p);
+}
+
+static void lsp_action(struct CharBuffer *output, bool *first, const char *title, const char *kind, const struct CharBuffer *uri,
+    size_t first_line, size_t first_character, size_t last_line, size_t last_character, const char *text, size_t size)
+{
+    //Code action with edit of one range
+    lsp_append(output, *first ? "{\"title\":" : ",{\"title\":");
+    *first = false;
+    lsp_append_string(output, title, strlen(title));
+    lsp_append(output, ",\"kind\":\"%s\",\"edit\":{\"changes\":{", kind);
+    lsp_append_string(output, uri->p, uri->size);
+    lsp_append(output, ":[{\"range\":");
+    lsp_range(output, first_line, first_character, last_line, last_character);
+    lsp_append(output, ",\"newText\":");
+    lsp_append_string(output, text, size);
+    lsp_append(output, "}]}}}");
+}
+
+static void lsp_code_actions(struct Server *server, const struct Document *document, const struct CharBuffer *uri, size_t line)
+{
+    //Actions of task on line, like kpd done, undo, priority and remove
+    struct CharBuffer *output = &server->output;
+    bool first = true;
+    lsp_append(output, "[");
+    struct CharBuffer text = { 0 };
+    struct Entry entry = { 0 };
+    if (document != NULL && line < document->lines_size)
+    {
+        const size_t end = lsp_line_end(document, line);
+        string_set_size(&text, end - document->lines[line]);
+        memcpy(text.p, document->text.p + document->lines[line], text.size);
+    }
+    if (text.size > 0 && kpd_read_line(&entry, &text))
+    {
+        const size_t end = lsp_character(document, line, lsp_line_end(document, line));
+        lsp_action(output, &first, entry.done ? "Mark task as not done" : "Mark task as done", "refactor.rewrite", uri, line, 4, line, 5, entry.done ? " " : "X", 1);
+
+        //Whole line is written like kpd writes it
+        const enum Priority priority = entry.priority;
+        const bool priority_explicit = entry.priority_explicit;
+        for (enum Priority new_priority = PRI_CRITICAL + 1; new_priority-- > PRI_LOW;)
+        {
+            if (priority_explicit && new_priority == priority) continue;
+            char *formatted = NULL;
+            size_t formatted_size = 0;
+            FILE *file = open_memstream(&formatted, &formatted_size);
+            if (file == NULL) kpd_error(ERR_MALLOC, "open_memstream() failed");
+            entry.priority = new_priority;
+            entry.priority_explicit = true;
+            kpd_write_entry(file, &entry);
+            if (fclose(file) != 0) kpd_error(ERR_MALLOC, "open_memstream() failed");
+            char title[64];
+            snprintf(title, sizeof(title), "Set priority to %s", kpd_priority_strings[new_priority]);
+            lsp_action(output, &first, title, "refactor.rewrite", uri, line, 0, line, end, formatted, formatted_size - 1);
+            free(formatted);
+        }
+        if (line + 1 < document->lines_size) lsp_action(output, &first, "Remove task", "refactor.rewrite", uri, line, 0, line + 1, 0, "", 0);
+        else lsp_action(output, &first, "Remove task", "refactor.rewrite", uri, line, 0, line, end, "", 0);
+    }
+
+    //Fixable problems of whole document, like kpd test --fix
+    bool fixable = false;
+    for (size_t i = 0; document != NULL && i < document->problems.size && !fixable; i++) fixable = document->problems.p[i].fixable;
+    if (fixable)
+    {
+        char *image = NULL;
+        size_t image_size = 0;
+        FILE *image_file = open_memstream(&image, &image_size);
+        if (image_file == NULL) kpd_error(ERR_MALLOC, "open_memstream() failed");
+        size_t counts[2];
+        validate_scan(counts, NULL, NULL, document->text.p, document->text.size, image_file);
+        if (fclose(image_file) != 0) kpd_error(ERR_MALLOC, "open_memstream() failed");
+        const size_t last = document->lines_size - 1;
+        lsp_action(output, &first, "Fix format problems", "quickfix", uri, 0, 0, last, lsp_character(document, last, document->text.size), image, image_size);
+        free(image);
+    }
+    lsp_append(output, "]}");
+    free(text.p);
+}
+
+static void lsp_completion(struct Server *server, const struct Document *document, size_t line, size_t character)
+{
+    //Priorities after "(priority:" or "(", replacing word before cursor
+    struct CharBuffer *output = &server->output;
+    lsp_append(output, "[");
+    if (document != NULL && line < document->lines_size)
+    {
+        const char *begin = document->text.p + document->lines[line];
+        const char *cursor = document->text.p + lsp_offset(document, line, character);
+        const char *word = cursor;
+        while (word > begin && word[-1] >= 'a' && word[-1] <= 'z') word--;
+        const char *marker = word;
+        while (marker > begin && marker[-1] == ' ') marker--;
+        const size_t prefix_length = strlen("(priority:");
+        const bool value = (size_t)(marker - begin) >= prefix_length && strncasecmp(marker - prefix_length, "(priority:", prefix_length) == 0;
+        const bool open = !value && marker == word && word > begin && word[-1] == '(';
+        const bool closed = *cursor == ')';
+        for (enum Priority priority = PRI_CRITICAL + 1; (value || open) && priority-- > PRI_LOW;)
+        {
+            char text[32];
+            snprintf(text, sizeof(text), "%s%s%s", open ? "priority: " : ((marker == word) ? " " : ""), kpd_priority_strings[priority], closed ? "" : ")");
+            const size_t cursor_character = lsp_character(document, line, (size_t)(cursor - document->text.p));
+            const size_t word_character = cursor_character - (size_t)(cursor - word);
+            if (priority != PRI_CRITICAL) lsp_append(output, ",");
+            lsp_append(output, "{\"label\":\"%s\",\"kind\":12,\"detail\":\"Priority\",\"sortText\":\"%u\",\"filterText\":\"%s\",\"textEdit\":{\"range\":",
+                kpd_priority_strings[priority], (unsigned int)(PRI_CRITICAL - priority), kpd_priority_strings[priority]);
+            lsp_range(output, line, word_character, line, cursor_character);
+            lsp_append(output, ",\"newText\":\"%s\"}}", text);
+        }
+    }
+    lsp_append(output, "]}");
+}
+
+static bool lsp_read(struct CharBuffer *message, struct CharBuffer *header)
+{
+    //Headers end with empty line, only Content-Length is needed
+    size_t length = SIZE_MAX;
+    while (true)
+    {
+        if (!string_set_line(header, stdin)) return false;
+        if (strcmp(header->p, "\r\n") == 0 || strcmp(header->p, "\n") == 0) break;
+        const size_t name_length = strlen("Content-Length:");
+        if (strncasecmp(header->p, "Content-Length:", name_length) == 0) length = (size_t)strtoull(header->p + name_length, NULL, 10);
+    }
+    if (length == SIZE_MAX) kpd_error(ERR_FORMAT, "message without Content-Length");
+    string_set_size(message, length);
+    return fread(message->p, 1, length, stdin) == length;
+}
+
+int lsp_run(void)
+{
+    struct Server server = { 0 };
+    struct CharBuffer header = { 0 };
+    struct CharBuffer uri = { 0 };
+    struct CharBuffer method = { 0 };
+    string_set_size(&header, INITIAL_BUFFER_SIZE);
+    bool shutdown = false;
+    int result = ERR_USAGE; //Exit without shutdown is an error
+    while (lsp_read(&server.message, &header))
+    {
+        //Method and ID, notifications have no ID
+        const struct CharBuffer *message = &server.message;
+        const size_t id = lsp_find(message, (const char *const[]){ "id", NULL });
+        lsp_string(&server.scratch, message, lsp_find(message, (const char *const[]){ "method", NULL }));
+        string_set_size(&method, 0);
+        string_substitute(&method, 0, 0, server.scratch.p, server.scratch.size);
+        if (method.size == 0) continue; //Responses to requests of server are not expected
+        lsp_string(&uri, message, lsp_find(message, (const char *const[]){ "params", "textDocument", "uri", NULL }));
+
+        //Lifecycle
+        if (strcmp(method.p, "initialize") == 0)
+        {
+            lsp_respond(&server, id, "result");
+            lsp_append(&server.output, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+                "\"codeActionProvider\":true,\"completionProvider\":{\"triggerCharacters\":[\"(\",\":\",\" \"]}},"
+                "\"serverInfo\":{\"name\":\"kpd\",\"version\":\"" VERSION "\"}}}");
+            lsp_send(&server.output);
+        }
+        else if (strcmp(method.p, "shutdown") == 0)
+        {
+            shutdown = true;
+            lsp_respond(&server, id, "result");
+            lsp_append(&server.output, "null}");
+            lsp_send(&server.output);
+        }
+        else if (strcmp(method.p, "exit") == 0)
+        {
+            result = shutdown ? ERR_OK : ERR_USAGE;
+            break;
+        }
+
+        //Document synchronization
+        else if (strcmp(method.p, "textDocument/didOpen") == 0)
+        {
+            struct Document *document = lsp_document(&server, &uri, true);
+            lsp_string(&server.scratch, message, lsp_find(message, (const char *const[]){ "params", "textDocument", "text", NULL }));
+            lsp_set_text(document, server.scratch.p, server.scratch.size);
+            lsp_publish(&server, document, &uri);
+        }
+        else if (strcmp(method.p, "textDocument/didChange") == 0)
+        {
+            struct Document *document = lsp_document(&server, &uri, false);
+            size_t i = lsp_find(message, (const char *const[]){ "params", "contentChanges", NULL });
+            if (document == NULL || i == SIZE_MAX || message->p[i] != '[') continue;
+            for (i = lsp_space(message->p, message->size, i + 1); i < message->size && message->p[i] == '{';)
+            {
+                //Changes with range are incremental, others replace whole text
+                lsp_string(&server.scratch, message, lsp_member(message->p, message->size, i, "text"));
+                const size_t range = lsp_member(message->p, message->size, i, "range");
+                if (range == SIZE_MAX || message->p[range] != '{')
+                {
+                    lsp_set_text(document, server.scratch.p, server.scratch.size);
+                }
+                else
+                {
+                    const size_t start = lsp_member(message->p, message->size, range, "start");
+                    const size_t end = lsp_member(message->p, message->size, range, "end");
+                    lsp_edit(document,
+                        lsp_number(message, lsp_member(message->p, message->size, start, "line")),
+                        lsp_number(message, lsp_member(message->p, message->size, start, "character")),
+                        lsp_number(message, lsp_member(message->p, message->size, end, "line")),
+                        lsp_number(message, lsp_member(message->p, message->size, end, "character")),
+                        server.scratch.p, server.scratch.size);
+                }
+                i = lsp_skip(message->p, message->size, i);
+                if (i == SIZE_MAX) break;
+                i = lsp_space(message->p, message->size, i);
+                if (i < message->size && message->p[i] == ',') i = lsp_space(message->p, message->size, i + 1);
+            }
+            lsp_publish(&server, document, &uri);
+        }
+        else if (strcmp(method.p, "textDocument/didClose") == 0)
+        {
+            struct Document *document = lsp_document(&server, &uri, false);
+            if (document != NULL) lsp_close(&server, document);
+            lsp_publish(&server, NULL, &uri);
+        }
+
+        //Language features
+        else if (strcmp(method.p, "textDocument/codeAction") == 0)
+        {
+            const size_t line = lsp_number(message, lsp_find(message, (const char *const[]){ "params", "range", "start", "line", NULL }));
+            lsp_respond(&server, id, "result");
+            lsp_code_actions(&server, lsp_document(&server, &uri, false), &uri, line);
+            lsp_send(&server.output);
+        }
+        else if (strcmp(method.p, "textDocument/completion") == 0)
+        {
+            const size_t line = lsp_number(message, lsp_find(message, (const char *const[]){ "params", "position", "line", NULL }));
+            const size_t character = lsp_number(message, lsp_find(message, (const char *const[]){ "params", "position", "character", NULL }));
+            lsp_respond(&server, id, "result");
+            lsp_completion(&server, lsp_document(&server, &uri, false), line, character);
+            lsp_send(&server.output);
+        }
+
+        //Other requests are not supported, other notifications are ignored
+        else if (id != SIZE_MAX)
+        {
+            lsp_respond(&server, id, "error");
+            lsp_append(&server.output, "{\"code\":-32601,\"message\":\"Method not found\"}}");
+            lsp_send(&server.output);
+        }
+    }
+
+    //Cleanup
+    while (server.size > 0) lsp_close(&server, &server.documents[0]);
+    free(server.documents);
+    free(server.message.p);
+    free(server.output.p);
+    free(server.scratch.p);
+    free(header.p);
+    free(uri.p);
+    free(method.p);
+    return result;
+}
@@ -4,10 +4,13 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static int kpd_init(int argc, char **argv)
 {
@@ -60,6 +63,7 @@ static int kpd_add(int argc, char **argv)
     if (argc > 2) kpd_error(ERR_USAGE, "too many arguments");
     entry.priority = PRI_MEDIUM;
     entry.priority_explicit = false;
+    entry.due = 0;
     entry.description = strdup(argv[0]);
     if (entry.description == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
     if (argc == 2)
@@ -73,8 +77,9 @@ static int kpd_add(int argc, char **argv)
     FILE *file;
     kpd_read_target(&file, &entries, NULL);
 
-    //Modify entries
+    //Modify entries, new entry follows the last one
     entry.number = entries.size;
+    entry.offset = (entries.size > 0) ? entries.p[entries.size - 1].offset : entries.opaque.size;
     entry.done = false;
     entries_set_size(&entries, entry.number + 1);
     entries.p[entry.number] = entry;
@@ -91,6 +96,85 @@ static int kpd_add(int argc, char **argv)
     return ERR_OK;
 }
 
+static int kpd_import(int argc, char **argv)
+{
+    //Parse options
+    enum Input input = INP_LINES;
+    const char *input_string;
+    if (kpd_parse_option(&argc, argv, "--format", &input_string) && !kpd_resolve_input(&input, input_string))
+        kpd_error(ERR_USAGE, "'%s' is not a valid input format", input_string);
+    const char *input_path = "-";
+    if (argc > 0 && !kpd_resolve_commit(argv[0]))
+    {
+        input_path = argv[0];
+        argc--;
+        argv++;
+    }
+    bool commit_suffix = false;
+    const char *commit_message = NULL;
+    if (argc > 2) kpd_error(ERR_USAGE, "too many arguments");
+    if (argc > 0)
+    {
+        if (!kpd_resolve_commit(argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid 'commit' suffix", argv[0]);
+        commit_suffix = true;
+        if (argc == 2) commit_message = argv[1];
+    }
+
+    //Read and validate records
+    struct EntryBuffer records = { 0 };
+    if (strcmp(input_path, "-") == 0)
+    {
+        if (kpd_get_source() == SRC_STDIN) kpd_error(ERR_USAGE, "records and " TARGET " cannot both be read from standard input");
+        import_read(&records, stdin, input);
+    }
+    else
+    {
+        FILE *input_file = fopen(input_path, "r");
+        if (input_file == NULL) kpd_error(ERR_NOT_FOUND, "file '%s' not found", input_path);
+        import_read(&records, input_file, input);
+        fclose(input_file);
+    }
+
+    //Parse TODO.md
+    struct EntryBuffer entries = { 0 };
+    FILE *file;
+    struct CharBuffer path = { 0 };
+    kpd_read_target(&file, &entries, commit_suffix ? &path : NULL);
+
+    //Modify entries, new entries follow the last one
+    const size_t offset = (entries.size > 0) ? entries.p[entries.size - 1].offset : entries.opaque.size;
+    const size_t old_size = entries.size;
+    entries_set_size(&entries, old_size + records.size);
+    for (size_t i = 0; i < records.size; i++)
+    {
+        struct Entry *entry = &entries.p[old_size + i];
+        *entry = records.p[i];
+        entry->number = old_size + i;
+        entry->offset = offset;
+    }
+
+    //Print
+    printf("Imported %u tasks\n", (unsigned int)records.size);
+
+    //Write TODO.md
+    kpd_write_target(file, &entries);
+
+    //Commit
+    if (commit_suffix && records.size > 0)
+    {
+        char default_message[64];
+        snprintf(default_message, sizeof(default_message), "Imported %u tasks", (unsigned int)records.size);
+        kpd_invoke_git(path.p, (commit_message != NULL) ? commit_message : default_message);
+    }
+
+    //Cleanup
+    fclose(file);
+    string_finalize(&path);
+    entries_finalize(&records, false);
+    entries_finalize(&entries, true);
+    return ERR_OK;
+}
+
 static int kpd_priority(int argc, char **argv)
 {
     //Parse options
@@ -100,13 +184,13 @@ static int kpd_priority(int argc, char **argv)
     if (argc > 2) kpd_error(ERR_USAGE, "too many arguments");
     if (argc == 1)
     {
-        if (kpd_parse_number(NULL, 0, argv[0])) number_string = argv[0];
+        if (kpd_parse_number(NULL, NULL, argv[0])) number_string = argv[0];
         else if (kpd_resolve_priority(&priority, argv[0])) priority_explicit = true;
         else kpd_error(ERR_USAGE, "'%s' is not a valid number or priority", argv[0]);
     }
     else if (argc == 2)
     {
-        if (!kpd_parse_number(NULL, 0, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[0]);
+        if (!kpd_parse_number(NULL, NULL, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[0]);
         if (!kpd_resolve_priority(&priority, argv[1])) kpd_error(ERR_USAGE, "'%s' is not a valid priority", argv[1]);
         number_string = argv[0];
         priority_explicit = true;
@@ -118,14 +202,11 @@ static int kpd_priority(int argc, char **argv)
     kpd_read_target(&file, &entries, NULL);
 
     //Modify entries
-    char *mask = (number_string != NULL) ? kpd_create_mask(entries.size, number_string) : kpd_create_mask_highest_open(&entries);
+    char *mask = (number_string != NULL) ? kpd_create_mask(&entries, number_string) : kpd_create_mask_highest_open(&entries);
     const char *mask_i = mask;
-    bool changes = false;
     for (struct Entry *entry = entries.p; entry < entries.p + entries.size; entry++, mask_i++)
     {
         if (!*mask_i) continue;
-        changes |= (entry->priority != priority);
-        changes |= (!!entry->priority_explicit != !!priority_explicit);
         entry->priority = priority;
         entry->priority_explicit = priority_explicit;
     }
@@ -134,7 +215,7 @@ static int kpd_priority(int argc, char **argv)
     kpd_print_entries(&entries, mask);
 
     //Write TODO.md
-    if (changes) kpd_write_target(file, &entries);
+    kpd_write_target(file, &entries);
 
     //Cleanup
     free(mask);
@@ -151,12 +232,12 @@ static int kpd_edit(int argc, char **argv)
     if (argc > 2) kpd_error(ERR_USAGE, "too many arguments");
     if (argc == 1)
     {
-        if (kpd_parse_number(NULL, 0, argv[0])) number_string = argv[0];
+        if (kpd_parse_number(NULL, NULL, argv[0])) number_string = argv[0];
         else description.p = argv[0];
     }
     else if (argc == 2)
     {
-        if (!kpd_parse_number(NULL, 0, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[0]);
+        if (!kpd_parse_number(NULL, NULL, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[0]);
         number_string = argv[0];
         description.p = argv[1];
     }
@@ -167,9 +248,10 @@ static int kpd_edit(int argc, char **argv)
     kpd_read_target(&file, &entries, NULL);
 
     //Modify entries
-    char *mask = (number_string != NULL) ? kpd_create_mask(entries.size, number_string) : kpd_create_mask_highest_open(&entries);
+    char *mask = (number_string != NULL) ? kpd_create_mask(&entries, number_string) : kpd_create_mask_highest_open(&entries);
     if (description.p == NULL)
     {
+        if (kpd_get_source() == SRC_STDIN) kpd_error(ERR_USAGE, "description is required when reading standard input");
         const size_t index = (size_t)((char*)memchr(mask, '\1', entries.size) - mask); //guaranteed because if mask was empty, parsing would have failed
         const char *old_description = entries.p[index].description;
         const char *prompt         = "New description (Enter to accept): ";
@@ -180,21 +262,20 @@ static int kpd_edit(int argc, char **argv)
         #endif
     }
     const char *mask_i = mask;
-    bool changes = false;
     for (struct Entry *entry = entries.p; entry < entries.p + entries.size; entry++, mask_i++)
     {
         if (!*mask_i) continue;
-        changes |= (strcmp(entry->description, description.p) != 0);
         free(entry->description);
         entry->description = strdup(description.p);
         if (entry->description == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+        if (strstr(description.p, DUE_MARKER) != NULL) entry->due = 0; //Marker in new description replaces old date
     }
 
     //Print
     kpd_print_entries(&entries, mask);
 
     //Write TODO.md
-    if (changes) kpd_write_target(file, &entries);
+    kpd_write_target(file, &entries);
 
     //Cleanup
     exit:
@@ -230,12 +311,12 @@ static int kpd_commit(int argc, char **argv)
     if (argc > 2) kpd_error(ERR_USAGE, "too many arguments");
     if (argc == 1)
     {
-        if (kpd_parse_number(NULL, 0, argv[0])) number_string = argv[0];
+        if (kpd_parse_number(NULL, NULL, argv[0])) number_string = argv[0];
         else commit_message.p = argv[0];
     }
     else if (argc == 2)
     {
-        if (!kpd_parse_number(NULL, 0, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[1]);
+        if (!kpd_parse_number(NULL, NULL, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[1]);
         number_string = argv[0];
         commit_message.p = argv[1];
     }
@@ -246,7 +327,7 @@ static int kpd_commit(int argc, char **argv)
     kpd_read_target(NULL, &entries, &path);
 
     //Print
-    char *mask = (number_string != NULL) ? kpd_create_mask(entries.size, number_string) : kpd_create_mask_highest_open(&entries);
+    char *mask = (number_string != NULL) ? kpd_create_mask(&entries, number_string) : kpd_create_mask_highest_open(&entries);
     kpd_print_entries(&entries, mask);
 
     //Ask user
@@ -263,6 +344,13 @@ static int kpd_commit(int argc, char **argv)
     return ERR_OK;
 }
 
+static int kpd_completion(int argc, char **argv)
+{
+    if (argc < 1) kpd_error(ERR_USAGE, "shell not specified");
+    if (argc > 1) kpd_error(ERR_USAGE, "too many arguments");
+    return complete_script(argv[0]);
+}
+
 static int kpd_remove_or_done_or_undo(int argc, char **argv, enum Action action)
 {
     //Parse options
@@ -272,13 +360,13 @@ static int kpd_remove_or_done_or_undo(int argc, char **argv, enum Action action)
     if (argc > 3) kpd_error(ERR_USAGE, "too many arguments");
     if (argc == 1)
     {
-        if (kpd_parse_number(NULL, 0, argv[0])) number_string = argv[0];
+        if (kpd_parse_number(NULL, NULL, argv[0])) number_string = argv[0];
         else if (kpd_resolve_commit(argv[0])) commit_suffix = true;
         else kpd_error(ERR_USAGE, "'%s' is not a valid number or 'commit' suffix", argv[0]);
     }
     else if (argc == 2)
     {
-        if (kpd_parse_number(NULL, 0, argv[0]))
+        if (kpd_parse_number(NULL, NULL, argv[0]))
         {
             if (kpd_resolve_commit(argv[1])) commit_suffix = true;
             else kpd_error(ERR_USAGE, "'%s' is not a valid number or 'commit' suffix", argv[1]);
@@ -293,7 +381,7 @@ static int kpd_remove_or_done_or_undo(int argc, char **argv, enum Action action)
     }
     else if (argc == 3)
     {
-        if (!kpd_parse_number(NULL, 0, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[1]);
+        if (!kpd_parse_number(NULL, NULL, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[1]);
         if (!kpd_resolve_commit(argv[1])) kpd_error(ERR_USAGE, "'%s' is not a valid 'commit' suffix", argv[1]);
         number_string = argv[0];
         commit_suffix = true;
@@ -303,55 +391,78 @@ static int kpd_remove_or_done_or_undo(int argc, char **argv, enum Action action)
     //Read TODO.md
     struct EntryBuffer entries = { 0 };
     FILE *file;
-    struct CharBuffer path;
-    kpd_read_target(&file, &entries, &path);
+    struct CharBuffer path = { 0 };
+    kpd_read_target(&file, &entries, commit_suffix ? &path : NULL);
 
     //Modify entries
-    char *mask = (number_string != NULL) ? kpd_create_mask(entries.size, number_string) : (
+    char *mask = (number_string != NULL) ? kpd_create_mask(&entries, number_string) : (
         (action != ACT_UNDO) ? kpd_create_mask_highest_open(&entries) : kpd_create_mask_last_closed(&entries)
     );
-    bool changes = false;
-    struct EntryBuffer entries_copy = { 0 };
-    struct EntryBuffer *entries_written = &entries;
-    if (action == ACT_REMOVE)
+    struct Graph graph;
+    graph_build(&graph, &entries);
+    char *changed = calloc(entries.size + 1, 1);
+    if (changed == NULL) kpd_error(ERR_MALLOC, "calloc() failed");
+    size_t changed_size = 0;
+    for (size_t i = 0; i < entries.size; i++)
     {
-        entries_set_size(&entries_copy, entries.size);
-        entries_copy.size = 0;
-        const char *mask_i = mask;
-        for (struct Entry *entry = entries.p; entry < entries.p + entries.size; entry++, mask_i++)
-        {
-            if (*mask_i) continue; //Skip removed entries
-            entries_copy.p[entries_copy.size] = *entry;
-            entries_copy.size++;
-        }
-        changes = true; //guaranteed because if mask was empty, parsing would have failed
-        entries_written = &entries_copy; //print copy instead
+        //Removed entries no longer block their dependents
+        if (mask[i]) changed_size += graph_set_done(changed, &graph, i, action != ACT_UNDO);
     }
-    else 
+    for (size_t i = 0; i < entries.size; i++)
+    {
+        if (mask[i] && changed[i]) { changed[i] = '\0'; changed_size--; }
+    }
+    if (action != ACT_REMOVE)
     {
         const char done = action == ACT_DONE;
         const char *mask_i = mask;
         for (struct Entry *entry = entries.p; entry < entries.p + entries.size; entry++, mask_i++)
         {
             if (!*mask_i) continue;
-            changes |= (!!entry->done != !!done);
             entry->done = done;
         }
     }
 
-    //Print
+    //Print, with dependents that changed
     kpd_print_entries(&entries, mask);
+    if (changed_size > 0)
+    {
+        printf((action == ACT_UNDO) ? "Blocked:\n" : "Unblocked:\n");
+        kpd_print_entries(&entries, changed);
+    }
 
     //Ask user
     if (commit_suffix && commit_message.p == NULL) kpd_commit_dialog(&entries, mask, &commit_message, action);
 
+    //Removed entries shift numbers of dependencies in whole TODO.md
+    struct EntryBuffer entries_copy = { 0 };
+    struct EntryBuffer *entries_written = &entries;
+    if (action == ACT_REMOVE)
+    {
+        kpd_read_whole(file, &entries, &mask);
+        graph_renumber(&entries, mask, NULL);
+        entries_set_size(&entries_copy, entries.size);
+        entries_copy.size = 0;
+        entries_copy.opaque = entries.opaque;
+        const char *mask_i = mask;
+        for (struct Entry *entry = entries.p; entry < entries.p + entries.size; entry++, mask_i++)
+        {
+            if (*mask_i) continue; //Skip removed entries
+            entries_copy.p[entries_copy.size] = *entry;
+            entries_copy.size++;
+        }
+        entries_written = &entries_copy; //print copy instead
+    }
+
     //Write TODO.md
-    if (changes) { kpd_write_target(file, entries_written); fflush(file); }
+    kpd_write_target(file, entries_written);
 
     //Commit
     if (commit_suffix) kpd_invoke_git(path.p, commit_message.p);
 
     //Cleanup
+    graph_finalize(&graph);
+    free(changed);
     free(mask);
     string_finalize(&path);
     fclose(file);
@@ -377,13 +488,322 @@ static int kpd_undo(int argc, char **argv)
 
 static int kpd_find(int argc, char **argv)
 {
-    (void)argc;
-    (void)argv;
-    kpd_error(ERR_NOT_IMPLEMENTED, "not implemented");
+    //Parse options
+    if (argc < 1) kpd_error(ERR_USAGE, "description is required");
+    enum Status status = STA_OPEN;
+    const int action_position = (argc > 1 && kpd_resolve_status(&status, argv[1])) ? 2 : 1;
+    enum Action action = ACT_COMMIT;
+    if (argc > action_position && !kpd_resolve_action(&action, argv[action_position]))
+        kpd_error(ERR_USAGE, "'%s' is not a valid action", argv[action_position]);
+
+    //Description is one literal string, quoted so that no word of it is taken as keyword
+    struct CharBuffer expression = { 0 };
+    string_set_size(&expression, 0);
+    string_substitute(&expression, expression.size, 0, "\"", 1);
+    for (const char *c = argv[0]; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\') string_substitute(&expression, expression.size, 0, "\\", 1);
+        string_substitute(&expression, expression.size, 0, c, 1);
+    }
+    string_substitute(&expression, expression.size, 0, "\" ", 2);
+    string_substitute(&expression, expression.size, 0, kpd_status_strings[status], strlen(kpd_status_strings[status]));
+    struct Query query;
+    query_compile(&query, 1, &expression.p, true);
+    free(expression.p);
+
+    //Print matches
+    if (argc == action_position)
+    {
+        struct EntryBuffer entries = { 0 };
+        kpd_read_target(NULL, &entries, NULL);
+        char *mask = malloc(entries.size + 1);
+        if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+        if (query_select(mask, &query, &entries) == 0) printf("No entries\n");
+        else kpd_print_entries(&entries, mask);
+        free(mask);
+        entries_finalize(&entries, true);
+        query_finalize(&query);
+        return ERR_OK;
+    }
+
+    //Matches replace default entry of action
+    Command *actions[6] = { kpd_commit, kpd_remove, kpd_done, kpd_undo, kpd_priority, kpd_edit };
+    kpd_set_query(&query);
+    const int result = actions[action](argc - action_position - 1, argv + action_position + 1);
+    kpd_set_query(NULL);
+    query_finalize(&query);
+    return result;
+}
+
+static int kpd_pick(int argc, char **argv)
+{
+    //Parse options, status selects candidates, lone 'done' is action
+    enum Status status = STA_OPEN;
+    enum Action action = ACT_COMMIT;
+    const bool status_given = argc > 0 && kpd_resolve_status(&status, argv[0]) && (argc > 1 || !kpd_resolve_action(&action, argv[0]));
+    if (!status_given) status = STA_OPEN;
+    const int action_position = status_given ? 1 : 0;
+    if (argc > action_position && !kpd_resolve_action(&action, argv[action_position]))
+        kpd_error(ERR_USAGE, "'%s' is not a valid action", argv[action_position]);
+    if (argc > action_position && kpd_get_source() != SRC_FILE) kpd_error(ERR_USAGE, "actions of pick are not available when reading standard input");
+
+    //Parse TODO.md
+    struct EntryStore store = { 0 };
+    kpd_read_store(&store);
+    char *mask = malloc(store.size + 1);
+    if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    size_t candidates = 0;
+    for (size_t i = 0; i < store.size; i++)
+    {
+        mask[i] = (char)(status == STA_ALL || ((store.flags[i] & FLAG_DONE) != 0) == (status == STA_DONE));
+        candidates += (size_t)mask[i];
+    }
+
+    //Pick, cancelled picker does nothing
+    int result = ERR_OK;
+    if (candidates == 0) printf("No entries\n");
+    else if (pick_run(mask, &store) == 0) { /*do nothing*/ }
+    else if (argc == action_position)
+    {
+        struct EntryBuffer entries = { 0 };
+        store_view(&entries, &store, NULL, mask);
+        kpd_print_entries(&entries, NULL);
+        entries_finalize(&entries, false);
+    }
+    else
+    {
+        //Picked numbers precede arguments of action
+        struct CharBuffer numbers = { 0 };
+        for (size_t i = 0; i < store.size; i++)
+        {
+            if (!mask[i]) continue;
+            char number[32];
+            const int size = snprintf(number, sizeof(number), (numbers.size == 0) ? "%u" : ",%u", (unsigned int)(i + 1));
+            string_substitute(&numbers, numbers.size, 0, number, (size_t)size);
+        }
+        const int action_argc = argc - action_position;
+        char **action_argv = malloc((size_t)action_argc * sizeof(*action_argv));
+        if (action_argv == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+        action_argv[0] = numbers.p;
+        for (int i = 1; i < action_argc; i++) action_argv[i] = argv[action_position + i];
+        Command *actions[6] = { kpd_commit, kpd_remove, kpd_done, kpd_undo, kpd_priority, kpd_edit };
+        result = actions[action](action_argc, action_argv);
+        free(action_argv);
+        free(numbers.p);
+    }
+
+    //Cleanup
+    free(mask);
+    store_finalize(&store);
+    return result;
+}
+
+static int kpd_id(int argc, char **argv)
+{
+    //Parse options
+    if (argc > 1) kpd_error(ERR_USAGE, "too many arguments");
+    if (argc == 1 && !kpd_parse_number(NULL, NULL, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid number", argv[0]);
+
+    //Read TODO.md
+    struct EntryBuffer entries = { 0 };
+    kpd_read_target(NULL, &entries, NULL);
+    char *mask = (argc == 1) ? kpd_create_mask(&entries, argv[0]) : NULL;
+
+    //Print
+    struct IdIndex index = { 0 };
+    id_index(&index, &entries);
+    for (size_t i = 0; i < entries.size; i++)
+    {
+        if (mask != NULL && !mask[i]) continue;
+        char id[17];
+        id_format(id, &index, i);
+        printf("@%s %s\n", id, entries.p[i].description);
+    }
+
+    //Cleanup
+    id_finalize(&index);
+    free(mask);
+    entries_finalize(&entries, true);
     return ERR_OK;
 }
 
 static int kpd_list(int argc, char **argv)
+{
+    //Parse options
+    const enum Format format = kpd_parse_format(&argc, argv);
+    size_t offset = 0, limit = SIZE_MAX;
+    const bool offset_given = kpd_parse_size(&argc, argv, "--offset", &offset);
+    const bool page = kpd_parse_size(&argc, argv, "--limit", &limit) || offset_given;
+    struct Query query;
+    query_compile(&query, argc, argv, true);
+
+    //Parse page only
+    if (page)
+    {
+        struct EntryBuffer entries = { 0 };
+        kpd_read_page(&entries, &query, false, offset, limit);
+        kpd_format_entries(&entries, NULL, format);
+        entries_finalize(&entries, true);
+        query_finalize(&query);
+        return ERR_OK;
+    }
+
+    //Parse TODO.md, archive only has done entries
+    struct EntryStore store = { 0 };
+    kpd_read_store(&store);
+    if (query.flags & QUERY_DONE) kpd_read_archive(&store);
+
+    //Select
+    char *mask = malloc(store.size + 1);
+    if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    query_select_store(mask, &query, &store);
+
+    //Print
+    struct EntryBuffer entries = { 0 };
+    store_view(&entries, &store, NULL, mask);
+    kpd_format_entries(&entries, NULL, format);
+
+    //Cleanup
+    free(mask);
+    entries_finalize(&entries, false);
+    store_finalize(&store);
+    query_finalize(&query);
+    return ERR_OK;
+}
+
+static int kpd_sort(int argc, char **argv)
+{
+    //Parse options
+    const enum Format format = kpd_parse_format(&argc, argv);
+    size_t offset = 0, limit = SIZE_MAX;
+    const bool offset_given = kpd_parse_size(&argc, argv, "--offset", &offset);
+    const bool page = kpd_parse_size(&argc, argv, "--limit", &limit) || offset_given;
+    struct Query query;
+    query_compile(&query, argc, argv, true);
+
+    //Parse page only
+    if (page)
+    {
+        struct EntryBuffer entries = { 0 };
+        kpd_read_page(&entries, &query, true, offset, limit);
+        kpd_format_entries(&entries, NULL, format);
+        entries_finalize(&entries, true);
+        query_finalize(&query);
+        return ERR_OK;
+    }
+
+    //Parse TODO.md, archive only has done entries
+    struct EntryStore store = { 0 };
+    kpd_read_store(&store);
+    if (query.flags & QUERY_DONE) kpd_read_archive(&store);
+
+    //Sort and select
+    size_t *order = malloc((store.size + 1) * sizeof(*order));
+    char *mask = malloc(store.size + 1);
+    if (order == NULL || mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    store_sort(order, &store);
+    query_select_store(mask, &query, &store);
+    struct Graph graph;
+    graph_build_store(&graph, &store);
+    graph_unblocked(mask, &graph);
+
+    //Print
+    struct EntryBuffer entries = { 0 };
+    store_view(&entries, &store, order, mask);
+    kpd_format_entries(&entries, NULL, format);
+
+    //Cleanup
+    graph_finalize(&graph);
+    free(order);
+    free(mask);
+    entries_finalize(&entries, false);
+    store_finalize(&store);
+    query_finalize(&query);
+    return ERR_OK;
+}
+
+static int kpd_next(int argc, char **argv)
+{
+    //Parse options
+    const enum Format format = kpd_parse_format(&argc, argv);
+    const bool due = kpd_parse_option(&argc, argv, "--due", NULL);
+    if (argc > 0) kpd_error(ERR_USAGE, "too many arguments");
+
+    //Parse TODO.md
+    struct EntryStore store = { 0 };
+    kpd_read_store(&store);
+
+    //Print, blocked entries are skipped
+    struct Graph graph;
+    graph_build_store(&graph, &store);
+    size_t highest_index;
+    bool found;
+    if (due)
+    {
+        //Earliest due date, popped until an entry is not blocked
+        struct DueHeap heap;
+        due_heap(&heap, &store);
+        while ((found = due_pop(&highest_index, &heap)) && graph_blocked(&graph, highest_index)) {}
+        due_finalize(&heap);
+    }
+    else found = graph_next(&highest_index, &graph);
+    struct EntryBuffer entries = { 0 };
+    if (found)
+    {
+        const size_t order[1] = { highest_index };
+        struct EntryStore highest = store;
+        highest.size = 1;
+        store_view(&entries, &highest, order, NULL);
+    }
+    if (format != FMT_TEXT) kpd_format_entries(&entries, NULL, format);
+    else if (!found) printf(due ? "Nothing due\n" : "Nothing to do\n");
+    else kpd_print_entry(&entries.p[0], 0, 0);
+
+    //Cleanup
+    graph_finalize(&graph);
+    entries_finalize(&entries, false);
+    store_finalize(&store);
+    return ERR_OK;
+}
+
+static int kpd_agenda(int argc, char **argv)
+{
+    //Parse options
+    const enum Format format = kpd_parse_format(&argc, argv);
+    size_t days = 7;
+    kpd_parse_size(&argc, argv, "--days", &days);
+    if (argc > 0) kpd_error(ERR_USAGE, "too many arguments");
+
+    //Parse TODO.md
+    struct EntryStore store = { 0 };
+    kpd_read_store(&store);
+
+    //Pop open entries due until the last day, overdue entries first
+    const unsigned int today = due_today();
+    const unsigned int last = (days > UINT_MAX - today) ? UINT_MAX : (today + (unsigned int)days);
+    struct DueHeap heap;
+    due_heap(&heap, &store);
+    size_t *order = malloc((store.size + 1) * sizeof(*order));
+    if (order == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    size_t size = 0;
+    while (due_pop(&order[size], &heap) && store.dues[order[size]] <= last) size++;
+
+    //Print
+    struct EntryBuffer entries = { 0 };
+    struct EntryStore due = store;
+    due.size = size;
+    store_view(&entries, &due, order, NULL);
+    kpd_format_entries(&entries, NULL, format);
+
+    //Cleanup
+    free(order);
+    due_finalize(&heap);
+    entries_finalize(&entries, false);
+    store_finalize(&store);
+    return ERR_OK;
+}
+
+static int kpd_count(int argc, char **argv)
 {
     //Parse options
     if (argc > 2) kpd_error(ERR_USAGE, "too many arguments");
@@ -403,103 +823,403 @@ static int kpd_list(int argc, char **argv)
         priority_explicit = true;
     }
 
-    //Parse TODO.md
-    struct EntryBuffer entries = { 0 };
-    kpd_read_target(NULL, &entries, NULL);
-
-    //Print
-    char *mask = NULL;
-    if (status != STA_ALL || priority_explicit)
+    //Count TODO.md
+    size_t counts[2][4];
+    kpd_read_counts(counts);
+    size_t total = 0;
+    for (unsigned int done = 0; done < 2; done++)
     {
-        mask = malloc(entries.size);
-        if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
-        memset(mask, '\0', entries.size);
-        char *mask_i = mask;
-        for (const struct Entry *entry = entries.p; entry < entries.p + entries.size; entry++, mask_i++)
+        if (status != STA_ALL && (status == STA_DONE) != (done == 1)) continue;
+        for (unsigned int i = PRI_LOW; i <= PRI_CRITICAL; i++)
         {
-            const bool priority_match = !priority_explicit || entry->priority == priority;
-            bool print;
-            if (status == STA_OPEN) print = priority_match & !entry->done;
-            else if (status == STA_DONE) print = priority_match & entry->done;
-            else print = priority_match;
-            if (print) *mask_i = '\1';
+            if (!priority_explicit || i == priority) total += counts[done][i];
         }
     }
-    kpd_print_entries(&entries, mask);
+
+    //Print
+    printf("%u\n", (unsigned int)total);
+    return ERR_OK;
+}
+
+static int kpd_stats(int argc, char **argv)
+{
+    //Parse options
+    const bool history = kpd_parse_option(&argc, argv, "--history", NULL);
+    if (argc > 0) kpd_error(ERR_USAGE, "too many arguments");
+
+    //Print numbers of tasks over time
+    if (history)
+    {
+        if (kpd_get_source() != SRC_FILE) kpd_error(ERR_USAGE, "git is not available when reading standard input");
+        struct CharBuffer path = { 0 };
+        kpd_find_target(&path);
+        history_counts(path.p);
+        free(path.p);
+        return ERR_OK;
+    }
+
+    //Print numbers of tasks by priority
+    size_t counts[2][4];
+    kpd_read_counts(counts);
+    size_t totals[2] = { 0, 0 };
+    printf("%-10s %6s %6s\n", "", "open", "done");
+    for (unsigned int i = PRI_CRITICAL + 1; i-- > PRI_LOW;)
+    {
+        printf("%-10s %6u %6u\n", kpd_priority_strings[i], (unsigned int)counts[0][i], (unsigned int)counts[1][i]);
+        totals[0] += counts[0][i];
+        totals[1] += counts[1][i];
+    }
+    printf("%-10s %6u %6u\n", "total", (unsigned int)totals[0], (unsigned int)totals[1]);
+    return ERR_OK;
+}
+
+static int kpd_log(int argc, char **argv)
+{
+    //Parse options
+    const char *since = NULL;
+    kpd_parse_option(&argc, argv, "--since", &since);
+    if (argc > 0) kpd_error(ERR_USAGE, "too many arguments");
+    if (kpd_get_source() != SRC_FILE) kpd_error(ERR_USAGE, "git is not available when reading standard input");
+
+    //Print timelines
+    struct CharBuffer path = { 0 };
+    kpd_find_target(&path);
+    history_log(path.p, since);
 
     //Cleanup
-    if (mask != NULL) free(mask);
-    entries_finalize(&entries, true);
+    free(path.p);
     return ERR_OK;
 }
 
-static int kpd_sort(int argc, char **argv)
+static int kpd_prompt(int argc, char **argv)
+{
+    //Parse options
+    if (argc > 1) kpd_error(ERR_USAGE, "too many arguments");
+    const char *format = (argc == 1) ? argv[0] : "%o";
+    const char *codes = "lmhcoadO";
+    for (const char *code = strchr(format, '%'); code != NULL; code = strchr(code + 2, '%'))
+    {
+        if (code[1] != '%' && (code[1] == '\0' || strchr(codes, code[1]) == NULL))
+            kpd_error(ERR_USAGE, "'%%%c' is not a valid code", code[1]);
+    }
+
+    //Count TODO.md
+    size_t counts[2][4];
+    kpd_read_counts(counts);
+    size_t values[8] = { counts[0][PRI_LOW], counts[0][PRI_MEDIUM], counts[0][PRI_HIGH], counts[0][PRI_CRITICAL] };
+    for (unsigned int i = PRI_LOW; i <= PRI_CRITICAL; i++)
+    {
+        values[4] += counts[0][i];
+        values[6] += counts[1][i];
+    }
+    values[5] = values[4] + values[6];
+
+    //Overdue entries need descriptions, parsed only when asked for
+    if (strstr(format, "%O") != NULL)
+    {
+        struct EntryStore store = { 0 };
+        kpd_read_store(&store);
+        const unsigned int today = due_today();
+        struct DueHeap heap;
+        due_heap(&heap, &store);
+        size_t index;
+        while (due_pop(&index, &heap) && store.dues[index] < today) values[7]++;
+        due_finalize(&heap);
+        store_finalize(&store);
+    }
+
+    //Print
+    for (const char *p = format; *p != '\0'; p++)
+    {
+        if (*p != '%') putchar(*p);
+        else if (*++p == '%') putchar('%');
+        else printf("%u", (unsigned int)values[strchr(codes, *p) - codes]);
+    }
+    putchar('\n');
+    return ERR_OK;
+}
+
+static int kpd_archive(int argc, char **argv)
 {
     //Parse options
+    size_t days = 0;
+    const bool older_than = kpd_parse_size(&argc, argv, "--older-than", &days);
+    bool commit_suffix = false;
+    const char *commit_message = "Archived done tasks";
     if (argc > 2) kpd_error(ERR_USAGE, "too many arguments");
-    enum Status status = STA_OPEN;
-    if (argc == 1)
+    if (argc > 0)
     {
-        if (!kpd_resolve_status(&status, argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid status or priority", argv[0]);
+        if (!kpd_resolve_commit(argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid 'commit' suffix", argv[0]);
+        commit_suffix = true;
+        if (argc == 2) commit_message = argv[1];
     }
+    if (older_than && kpd_get_section() != NULL) kpd_error(ERR_USAGE, "--older-than is not available for sections");
+    if (kpd_get_source() != SRC_FILE) kpd_error(ERR_USAGE, "archive is not available when reading standard input");
 
-    //Parse TODO.md
+    //Read TODO.md
     struct EntryBuffer entries = { 0 };
-    kpd_read_target(NULL, &entries, NULL);
+    FILE *file;
+    struct CharBuffer path = { 0 };
+    kpd_read_target(&file, &entries, &path);
 
-    //Print
-    entries_sort(&entries);
+    //Select done entries
     char *mask = malloc(entries.size);
-    if (mask == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
-    memset(mask, '\0', entries.size);
-    char *mask_i = mask;
-    for (const struct Entry *entry = entries.p; entry < entries.p + entries.size; entry++, mask_i++)
+    long *times = calloc(entries.size, sizeof(*times));
+    if (mask == NULL || times == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    if (older_than) kpd_read_times(times, entries.size, path.p);
+    const long now = (long)time(NULL);
+    size_t archived = 0;
+    for (size_t i = 0; i < entries.size; i++)
     {
-        bool print;
-        if (status == STA_OPEN) print = !entry->done;
-        else if (status == STA_DONE) print = entry->done;
-        else print = true;
-        if (print) *mask_i = '\1';
+        mask[i] = (char)(entries.p[i].done && (!older_than || now - times[i] >= (long)days * 24 * 60 * 60));
+        archived += (size_t)mask[i];
+    }
+
+    if (archived == 0)
+    {
+        printf("Nothing to archive\n");
+    }
+    else
+    {
+        //Print
+        kpd_print_entries(&entries, mask);
+
+        //Append to TODO.archive.md, then rewrite TODO.md without archived entries
+        kpd_write_archive(path.p, &entries, mask);
+        kpd_read_whole(file, &entries, &mask);
+        graph_renumber(&entries, mask, NULL);
+        struct EntryBuffer entries_copy = { 0 };
+        entries_set_size(&entries_copy, entries.size);
+        entries_copy.size = 0;
+        entries_copy.opaque = entries.opaque;
+        for (size_t i = 0; i < entries.size; i++)
+        {
+            if (!mask[i]) entries_copy.p[entries_copy.size++] = entries.p[i];
+        }
+        kpd_write_target(file, &entries_copy);
+        entries_finalize(&entries_copy, false);
+
+        //Commit
+        if (commit_suffix)
+        {
+            struct CharBuffer archive_path = { 0 };
+            string_substitute(&archive_path, 0, 0, path.p, path.size);
+            kpd_archive_path(&archive_path);
+            kpd_invoke_git_add(archive_path.p);
+            kpd_invoke_git(path.p, commit_message);
+            free(archive_path.p);
+        }
     }
-    kpd_print_entries(&entries, mask);
 
     //Cleanup
+    free(times);
     free(mask);
+    fclose(file);
+    string_finalize(&path);
     entries_finalize(&entries, true);
     return ERR_OK;
 }
 
-static int kpd_next(int argc, char **argv)
+static int kpd_dedupe(int argc, char **argv)
 {
     //Parse options
-    (void)argv;
-    if (argc > 0) kpd_error(ERR_USAGE, "too many arguments");
+    const bool dry_run = kpd_parse_option(&argc, argv, "--dry-run", NULL);
+    bool commit_suffix = false;
+    const char *commit_message = NULL;
+    if (argc > 2) kpd_error(ERR_USAGE, "too many arguments");
+    if (argc > 0)
+    {
+        if (!kpd_resolve_commit(argv[0])) kpd_error(ERR_USAGE, "'%s' is not a valid 'commit' suffix", argv[0]);
+        if (dry_run) kpd_error(ERR_USAGE, "--dry-run cannot be combined with 'commit' suffix");
+        commit_suffix = true;
+        if (argc == 2) commit_message = argv[1];
+    }
 
-    //Parse TODO.md
+    //Read TODO.md
     struct EntryBuffer entries = { 0 };
-    kpd_read_target(NULL, &entries, NULL);
+    FILE *file = NULL;
+    struct CharBuffer path = { 0 };
+    kpd_read_target(dry_run ? NULL : &file, &entries, commit_suffix ? &path : NULL);
+
+    //Find duplicates
+    char *mask = malloc(entries.size + 1);
+    size_t *kept = malloc((entries.size + 1) * sizeof(*kept));
+    if (mask == NULL || kept == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    const size_t duplicates = entries_dedupe(mask, kept, &entries);
 
     //Print
-    size_t highest_index;
-    if (!entries_highest_open(&highest_index, &entries)) printf("Nothing to do\n");
-    else kpd_print_entry(&entries.p[highest_index], 0, 0);
+    if (duplicates == 0) printf("No duplicates\n");
+    else kpd_print_entries(&entries, mask);
+
+    //Write TODO.md without duplicates
+    if (!dry_run)
+    {
+        //References to duplicates point to entries they are merged into, section is widened like mask
+        const size_t first = entries.first;
+        const size_t section_size = entries.size;
+        kpd_read_whole(file, &entries, &mask);
+        if (entries.size != section_size)
+        {
+            size_t *whole_kept = malloc((entries.size + 1) * sizeof(*whole_kept));
+            if (whole_kept == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+            for (size_t i = 0; i < entries.size; i++) whole_kept[i] = SIZE_MAX;
+            for (size_t i = 0; i < section_size; i++) whole_kept[first + i] = (kept[i] == SIZE_MAX) ? SIZE_MAX : (first + kept[i]);
+            free(kept);
+            kept = whole_kept;
+        }
+        graph_renumber(&entries, mask, kept);
+        struct EntryBuffer entries_copy = { 0 };
+        entries_set_size(&entries_copy, entries.size);
+        entries_copy.size = 0;
+        entries_copy.opaque = entries.opaque;
+        for (size_t i = 0; i < entries.size; i++)
+        {
+            if (!mask[i]) entries_copy.p[entries_copy.size++] = entries.p[i];
+        }
+        kpd_write_target(file, &entries_copy);
+        entries_finalize(&entries_copy, false);
+    }
+
+    //Commit
+    if (commit_suffix && duplicates > 0)
+    {
+        char default_message[64];
+        snprintf(default_message, sizeof(default_message), "Removed %u duplicate tasks", (unsigned int)duplicates);
+        kpd_invoke_git(path.p, (commit_message != NULL) ? commit_message : default_message);
+    }
 
     //Cleanup
+    free(kept);
+    free(mask);
+    if (file != NULL) fclose(file);
+    string_finalize(&path);
     entries_finalize(&entries, true);
     return ERR_OK;
 }
 
-static int kpd_test(int argc, char **argv)
+static int kpd_merge_driver(int argc, char **argv)
+{
+    //Parse options
+    if (argc < 3) kpd_error(ERR_USAGE, "base, ours and theirs files are required");
+    if (argc > 3) kpd_error(ERR_USAGE, "too many arguments");
+
+    //Read all versions
+    struct EntryBuffer versions[3] = { { 0 } };
+    for (size_t i = 0; i < 3; i++)
+    {
+        if (!kpd_read_path(&versions[i], argv[i])) kpd_error(ERR_NOT_FOUND, "cannot open '%s'", argv[i]);
+    }
+
+    //Merge into memory, ours stays intact if merge fails
+    struct CharBuffer result = { 0 };
+    FILE *stream = open_memstream(&result.p, &result.size);
+    if (stream == NULL) kpd_error(ERR_MALLOC, "open_memstream() failed");
+    const size_t conflicts = merge_write(stream, &versions[0], &versions[1], &versions[2]);
+    if (fclose(stream) != 0) kpd_error(ERR_MALLOC, "open_memstream() failed");
+
+    //Replace ours with result, like git expects
+    FILE *file = fopen(argv[1], "w");
+    if (file == NULL) kpd_error(ERR_NOT_FOUND, "cannot open '%s'", argv[1]);
+    fwrite(result.p, 1, result.size, file);
+    fclose(file);
+    if (conflicts > 0) kpd_error(ERR_CONFLICT, "%u conflicting tasks in '%s'", (unsigned int)conflicts, argv[1]);
+
+    //Cleanup
+    free(result.p);
+    for (size_t i = 0; i < 3; i++) entries_finalize(&versions[i], true);
+    return ERR_OK;
+}
+
+static int kpd_watch(int argc, char **argv)
+{
+    //Parse options
+    Command *commands[] = { kpd_list, kpd_sort, kpd_next, kpd_agenda };
+    const char *command_strings[] = { "list", "sort", "next", "agenda" };
+    size_t command_index = 1;
+    if (argc > 0 && !string_resolve(&command_index, argv[0], command_strings, sizeof(command_strings)/sizeof(*command_strings)))
+        kpd_error(ERR_USAGE, "'%s' is not one of: list | sort | next | agenda", argv[0]);
+    const int command_argc = (argc > 0) ? (argc - 1) : 0;
+
+    //Watch TODO.md
+    return watch_run(commands[command_index], command_argc, argv + (argc - command_argc));
+}
+
+static int kpd_lsp(int argc, char **argv)
 {
     //Parse options
     (void)argv;
     if (argc > 0) kpd_error(ERR_USAGE, "too many arguments");
+    if (kpd_get_source() == SRC_STDIN) kpd_error(ERR_USAGE, "lsp is not available when reading standard input");
 
-    //Parse TODO.md
-    kpd_read_target(NULL, NULL, NULL);
+    //Documents come from editor
+    return lsp_run();
+}
+
+static int kpd_test(int argc, char **argv)
+{
+    //Parse options, revisions are the rest of arguments
+    const bool fix = kpd_parse_option(&argc, argv, "--fix", NULL);
+    const bool staged = kpd_parse_option(&argc, argv, "--staged", NULL);
+    int revisions_argc = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--rev") != 0) continue;
+        revisions_argc = argc - i - 1;
+        if (revisions_argc == 0) kpd_error(ERR_USAGE, "'--rev' requires a value");
+        argc = i;
+    }
+    if (argc > 0) kpd_error(ERR_USAGE, "too many arguments");
+
+    //Check index or commits, working tree is not read
+    if (staged || revisions_argc > 0)
+    {
+        if (fix) kpd_error(ERR_USAGE, "only working tree can be fixed");
+        if (kpd_get_source() != SRC_FILE) kpd_error(ERR_USAGE, "git is not available when reading standard input");
+        struct CharBuffer path = { 0 };
+        kpd_find_target(&path);
+        size_t counts[2] = { 0, 0 };
+        char *index[1] = { "" };
+        if (staged) validate_revisions(counts, path.p, index, 1);
+        if (revisions_argc > 0) validate_revisions(counts, path.p, argv + argc + 1, (size_t)revisions_argc);
+        free(path.p);
+        if (counts[0] > 0) kpd_error(ERR_FORMAT, "%u problems found", (unsigned int)counts[0]);
+        printf("All correct\n");
+        return ERR_OK;
+    }
+
+    //Read raw TODO.md
+    FILE *file = NULL;
+    struct CharBuffer content = { 0 };
+    struct CharBuffer path = { 0 };
+    const bool stdin_source = kpd_get_source() == SRC_STDIN;
+    kpd_read_raw(fix ? &file : NULL, &content, stdin_source ? NULL : &path);
+
+    //Check every line, fix in the same pass
+    size_t counts[2];
+    struct CharBuffer image = { 0 };
+    FILE *image_file = NULL;
+    if (fix)
+    {
+        image_file = open_memstream(&image.p, &image.size);
+        if (image_file == NULL) kpd_error(ERR_MALLOC, "open_memstream() failed");
+    }
+    validate_scan(counts, stdout, stdin_source ? "-" : path.p, content.p, content.size, image_file);
+    if (fix)
+    {
+        if (fclose(image_file) != 0) kpd_error(ERR_MALLOC, "open_memstream() failed");
+        kpd_write_raw(file, &content, image.p, image.size);
+        fclose(file);
+    }
+
+    //Cleanup
+    free(image.p);
+    free(content.p);
+    free(path.p);
 
     //Print
-    printf("All correct\n");
+    if (counts[0] == 0) printf("All correct\n");
+    else if (counts[1] == counts[0]) printf("Fixed %u problems\n", (unsigned int)counts[1]);
+    else kpd_error(ERR_FORMAT, "%u problems found", (unsigned int)(counts[0] - counts[1]));
     return ERR_OK;
 }
 
@@ -511,11 +1231,24 @@ static int kpd_help(int argc, char **argv)
         "Kyrylo's Personal Dispatcher, version " VERSION "\n"
         "\n"
         "Placeholders:\n"
-        "  <number>      Entry number or comma-separated list, defaults to task with highest priority\n"
+        "  <number>      Entry number, range, @ID or comma-separated list of them,\n"
+        "                defaults to task with highest priority\n"
         "  <priority>    One of: low | medium | high | critical, defaults to 'medium'\n"
         "  <status>      One of: all | open | done, defaults to 'open'\n"
+        "  <query>       <status>, <priority>, +project and @context tags and words of description,\n"
+        "                or expression of: open | done | +<tag> | @<tag> | @ID |\n"
+        "                  priority <op> <priority> | desc <op> <text> |\n"
+        "                  not <query> | <query> and <query> | <query> or <query> | (<query>)\n"
+        "                with <op> one of: = != < <= > >= ~ (contains) !~, defaults to 'open',\n"
+        "                keywords are not abbreviated, quoted text is never a keyword\n"
         "  <directory>   Directory to contain TODO.md, defaults to current directory\n"
-        "  <description> Description of the task\n"
+        "  <description> Description of the task, (after: <number>, @<id>) makes it wait for\n"
+        "                other tasks (numbered in whole file, even with --section), remove,\n"
+        "                archive and dedupe keep its numbers up to date,\n"
+        "                (due: YYYY-MM-DD) gives it a due date\n"
+        "  <format>      One of: text | json | ndjson | tsv, defaults to 'text'\n"
+        "  <prompt>      Text with counts of open tasks: %%o, %%c, %%h, %%m, %%l (by priority),\n"
+        "                all: %%a, done: %%d, overdue: %%O, percent sign: %%%%\n"
         "  <action>      Action to be performed on found entries, one of:\n"
         "                  <commit> | remove <commit> | done <commit> | undo <commit> |\n"
         "                  priority <priority> | edit [<description>]\n"
@@ -526,28 +1259,79 @@ static int kpd_help(int argc, char **argv)
         "                  3. call 'git commit' with a commit message\n"
         "                    (generated from <description> by default)\n"
         "\n"
+    );
+    printf(
         "Commands:\n"
         "  init      [<directory>]               Initialize kpd in a directory\n"
         "  add       <description> [<priority>]  Add task\n"
+        "  import    [<file>] [<commit>]         Add tasks from file or standard input ('-'),\n"
+        "                                        one per line, or CSV/NDJSON with --format\n"
         "\n"
         "  priority  [<number>] [<priority>]     Set task priority\n"
         "  edit      [<number>] [<description>]  Edit or set task description\n"
         "  commit    [<number>] [<message>]      Perform git commit, see description of <commit>\n"
+        "  completion <shell>                    Print completion script for bash, zsh or fish\n"
         "  remove    [<number>] [<commit>]       Remove task\n"
-        "  done      [<number>] [<commit>]       Mark task as done\n"
+        "  done      [<number>] [<commit>]       Mark task as done, print tasks it unblocks\n"
         "  undo      [<number>] [<commit>]       Mark task as not done, defaults to last done task\n"
         "\n"
-        "  list      [<status>] [<priority>]     List entries\n"
-        "  sort      [<status>]                  List entries sorted by priority (default command)\n"
-        "  next                                  Print next task\n"
-        "  test                                  Check if TODO.md exists and has the correct format\n"
+        "  id        [<number>]                  Print IDs of tasks, derived from their descriptions\n"
+        "  list      [<query>]                   List entries\n"
+        "  sort      [<query>]                   List entries sorted by priority (default command),\n"
+        "                                        skip tasks waiting for open tasks\n"
+        "  next      [--due]                     Print next task that is not waiting for open tasks,\n"
+        "                                        or the one due first with --due\n"
+        "  agenda    [--days <days>]             List open tasks due in <days> (default 7) or overdue,\n"
+        "                                        earliest first\n"
+        "  count     [<status>] [<priority>]     Print number of entries\n"
+        "  stats     [--history]                 Print numbers of tasks by priority, or open and done\n"
+        "                                        tasks at end of every day, according to git\n"
+        "  log       [--since <date>]            Print when tasks were added, done, reopened,\n"
+        "                                        reprioritized and removed, according to git\n"
+        "  prompt    [<prompt>]                  Print counts for shell prompt, defaults to '%%o'\n"
+        "  archive   [<commit>]                  Move done tasks to TODO.archive.md,\n"
+        "                                        list and sort read it for done tasks,\n"
+        "                                        numbered A1, A2, ...\n"
+        "  dedupe    [<commit>]                  Merge tasks with same description (ignoring case,\n"
+        "                                        spaces and trailing punctuation), keep open state,\n"
+        "                                        highest priority and earliest due date\n"
+        "  merge-driver <base> <ours> <theirs>   Merge versions of TODO.md task by task, for git:\n"
+        "                                        'TODO.md merge=kpd' in .gitattributes and\n"
+        "                                        merge.kpd.driver = kpd merge-driver %%O %%A %%B\n"
+        "  watch     [<command> <option>*]       Run list, sort, next or agenda, redraw on every change\n"
+        "  lsp                                   Run language server on standard input and output:\n"
+        "                                        problems of kpd test while editing, actions of\n"
+        "                                        done, undo, priority and remove, priority completion\n"
+        "  test      [--fix | --staged]          Check format and dependencies of TODO.md, print every\n"
+        "            [--rev <rev>*]              problem with line and column, fix what can be fixed\n"
+        "                                        with --fix, check index or revisions instead of\n"
+        "                                        working tree\n"
         "  find      <description>\n"
         "            [<status>] [<action>]       Find task by description and execute command\n"
+        "  pick      [<status>] [<action>]       Pick tasks by typing parts of their descriptions,\n"
+        "                                        Tab marks several, Enter executes command\n"
         "\n"
         "  help    | --help    | -h              Print this help\n"
         "  version | --version | -v              Print version\n"
         "\n"
-        "All keywords can be resolved by first letter\n"
+    );
+    printf(
+        "Options:\n"
+        "  - | --stdin                           Read TODO.md from standard input,\n"
+        "                                        print modified TODO.md to standard output\n"
+        "                                        (must precede <command>)\n"
+        "  --format <format>                     Output format of list, sort, next and agenda,\n"
+        "                                        or lines | csv | ndjson for import\n"
+        "  --dry-run                             Only print what dedupe would remove\n"
+        "  --offset <count>                      Skip <count> entries of list or sort\n"
+        "  --limit <count>                       Print at most <count> entries of list or sort\n"
+        "  --days <days>                         Only list tasks due in <days> with agenda\n"
+        "  --older-than <days>                   Only archive tasks done <days> ago, according to git\n"
+        "  --since <date>                        Only log changes after <date>, in any format of git\n"
+        "  --section <heading>                   Only read and modify entries under a heading,\n"
+        "                                        numbers start from 1 in the section\n"
+        "\n"
+        "All keywords can be abbreviated, the first match wins\n"
     );
     return ERR_OK;
 }
@@ -567,10 +1351,41 @@ static int kpd_version(int argc, char **argv)
 
 int main(int argc, char **argv)
 {
+    Command *commands[] =
+    {
+        kpd_init, kpd_add, kpd_import,
+        kpd_priority, kpd_edit, kpd_commit, kpd_completion, kpd_remove, kpd_done, kpd_undo,
+        kpd_find, kpd_pick, kpd_id, kpd_list, kpd_sort, kpd_next, kpd_agenda, kpd_count, kpd_stats, kpd_log, kpd_prompt, kpd_archive, kpd_dedupe, kpd_merge_driver, kpd_watch, kpd_lsp, kpd_test,
+        kpd_help, kpd_version
+    };
+    const char *command_strings[] =
+    {
+        "init", "add", "import",
+        "priority", "edit", "commit", "completion", "remove", "done", "undo",
+        "find", "pick", "id", "list", "sort", "next", "agenda", "count", "stats", "log", "prompt", "archive", "dedupe", "merge-driver", "watch", "lsp", "test",
+        "help", "version"
+    };
+    const size_t commands_size = sizeof(command_strings)/sizeof(*command_strings);
+
+    //Shell completion, words are not options
+    if (argc > 1 && strcmp(argv[1], "__complete") == 0) return complete_run(argc - 2, argv + 2, command_strings, commands_size);
+
+    //Global options
+    if (argc > 1 && (strcmp(argv[1], "-") == 0 || strcmp(argv[1], "--stdin") == 0))
+    {
+        kpd_set_source(SRC_STDIN, NULL);
+        argc--;
+        argv++;
+    }
+    int option_argc = argc - 1;
+    const char *section;
+    if (kpd_parse_option(&option_argc, argv + 1, "--section", &section)) kpd_set_section(section);
+    argc = option_argc + 1;
+
     if (argc <= 1)
     {
-        //No arguments
-        return kpd_sort(0, NULL);
+        //No arguments, options are looked up in empty vector
+        return kpd_sort(0, argv + argc);
     }
     else if (argv[1][0] == '-')
     {
@@ -584,23 +1399,9 @@ int main(int argc, char **argv)
     else
     {
         //Main operation
-        Command *commands[] =
-        {
-            kpd_init, kpd_add,
-            kpd_priority, kpd_edit, kpd_commit, kpd_remove, kpd_done, kpd_undo,
-            kpd_find, kpd_list, kpd_sort, kpd_next, kpd_test,
-            kpd_help, kpd_version
-        };
-        const char *command_strings[] =
-        {
-            "init", "add",
-            "priority", "edit", "commit", "remove", "done", "undo",
-            "find", "list", "sort", "next", "test",
-            "help", "version"
-        };
         const char *command_string = argv[1];
         size_t command_index;
-        if (!string_resolve(&command_index, command_string, command_strings, sizeof(command_strings)/sizeof(*command_strings)))
+        if (!string_resolve(&command_index, command_string, command_strings, commands_size))
             kpd_error(ERR_USAGE, "'%s' is not a valid command", command_string);
         Command *command = commands[command_index];
         if (command != NULL) return command(argc - 2, argv + 2);
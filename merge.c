@@ -0,0 +1,283 @@
+#include "kpd.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+///Entries indexed by description hash, entries with equal descriptions are chained in order
+struct MergeIndex
+{
+    const struct EntryBuffer *entries;
+    size_t *slots;      ///< First entry with description, SIZE_MAX for empty slot
+    size_t *cursors;    ///< First entry with description that was not matched yet
+    size_t *next;       ///< Next entry with same description, SIZE_MAX for last
+    size_t capacity;    ///< Power of two, at least twice the number of entries
+};
+
+//Needed by merge_write
+static void merge_index(struct MergeIndex *index, const struct EntryBuffer *entries, const size_t *skip)
+{
+    //Open addressing with linear probing, at most half full
+    index->entries = entries;
+    index->capacity = 1;
+    while (index->capacity < 2 * entries->size) index->capacity <<= 1;
+    index->slots = malloc(index->capacity * sizeof(*index->slots));
+    index->cursors = malloc(index->capacity * sizeof(*index->cursors));
+    index->next = malloc((entries->size + 1) * sizeof(*index->next));
+    if (index->slots == NULL || index->cursors == NULL || index->next == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < index->capacity; i++) index->slots[i] = SIZE_MAX;
+
+    //Chain from the back, so chains keep order of entries
+    for (size_t i = entries->size; i-- > 0;)
+    {
+        index->next[i] = SIZE_MAX;
+        if (skip != NULL && skip[i] != SIZE_MAX) continue;
+        const char *description = entries->p[i].description;
+        size_t slot = (size_t)string_hash(description, strlen(description)) & (index->capacity - 1);
+        while (index->slots[slot] != SIZE_MAX && strcmp(entries->p[index->slots[slot]].description, description) != 0)
+            slot = (slot + 1) & (index->capacity - 1);
+        index->next[i] = index->slots[slot];
+        index->slots[slot] = i;
+    }
+    memcpy(index->cursors, index->slots, index->capacity * sizeof(*index->cursors));
+}
+
+static size_t merge_lookup(struct MergeIndex *index, const char *description)
+{
+    //Every entry is matched at most once
+    size_t slot = (size_t)string_hash(description, strlen(description)) & (index->capacity - 1);
+    while (index->slots[slot] != SIZE_MAX)
+    {
+        if (strcmp(index->entries->p[index->slots[slot]].description, description) == 0)
+        {
+            const size_t found = index->cursors[slot];
+            if (found != SIZE_MAX) index->cursors[slot] = index->next[found];
+            return found;
+        }
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+    return SIZE_MAX;
+}
+
+static void merge_index_finalize(struct MergeIndex *index)
+{
+    free(index->slots);
+    free(index->cursors);
+    free(index->next);
+    memset(index, 0, sizeof(*index));
+}
+
+static void merge_match(size_t *side_to_base, size_t *base_to_side, struct MergeIndex *index, const struct EntryBuffer *base, const struct EntryBuffer *side)
+{
+    //Same description
+    memcpy(index->cursors, index->slots, index->capacity * sizeof(*index->cursors));
+    for (size_t j = 0; j < base->size; j++) base_to_side[j] = SIZE_MAX;
+    for (size_t i = 0; i < side->size; i++)
+    {
+        side_to_base[i] = merge_lookup(index, side->p[i].description);
+        if (side_to_base[i] != SIZE_MAX) base_to_side[side_to_base[i]] = i;
+    }
+
+    //Edited description, unmatched entry takes place of unmatched entry following the same neighbour
+    for (size_t i = 0; i < side->size; i++)
+    {
+        if (side_to_base[i] != SIZE_MAX) continue;
+        const size_t j = (i == 0) ? 0 : (side_to_base[i - 1] == SIZE_MAX) ? SIZE_MAX : (side_to_base[i - 1] + 1);
+        if (j >= base->size || base_to_side[j] != SIZE_MAX) continue;
+        side_to_base[i] = j;
+        base_to_side[j] = i;
+    }
+}
+
+static bool merge_equal(const struct Entry *a, const struct Entry *b)
+{
+    return a->done == b->done
+        && a->priority == b->priority
+        && a->priority_explicit == b->priority_explicit
+        && a->due == b->due
+        && strcmp(a->description, b->description) == 0;
+}
+
+static bool merge_fields(struct Entry *merged, const struct Entry *base, const struct Entry *ours, const struct Entry *theirs)
+{
+    //Every field takes the side that changed it, different changes on both sides conflict
+    *merged = *ours;
+    if (base == NULL) return merge_equal(ours, theirs);
+    if (ours->done == base->done) merged->done = theirs->done;
+    const bool ours_priority = ours->priority != base->priority || ours->priority_explicit != base->priority_explicit;
+    const bool theirs_priority = theirs->priority != base->priority || theirs->priority_explicit != base->priority_explicit;
+    if (!ours_priority)
+    {
+        merged->priority = theirs->priority;
+        merged->priority_explicit = theirs->priority_explicit;
+    }
+    else if (theirs_priority && (ours->priority != theirs->priority || ours->priority_explicit != theirs->priority_explicit)) return false;
+    if (ours->due == base->due) merged->due = theirs->due;
+    else if (theirs->due != base->due && theirs->due != ours->due) return false;
+    if (strcmp(ours->description, base->description) == 0) merged->description = theirs->description;
+    else if (strcmp(theirs->description, base->description) != 0 && strcmp(theirs->description, ours->description) != 0) return false;
+    return true;
+}
+
+static void merge_conflict(void *file, const struct Entry *ours, const struct Entry *theirs, bool swapped)
+{
+    //Same markers as git, missing side is empty
+    if (swapped)
+    {
+        const struct Entry *swap = ours;
+        ours = theirs;
+        theirs = swap;
+    }
+    fputs("<<<<<<< ours\n", file);
+    if (ours != NULL) kpd_write_entry(file, ours);
+    fputs("=======\n", file);
+    if (theirs != NULL) kpd_write_entry(file, theirs);
+    fputs(">>>>>>> theirs\n", file);
+}
+
+static bool merge_same_layout(const struct EntryBuffer *a, const struct EntryBuffer *b)
+{
+    //Without lines other than tasks there is no buffer to compare
+    return a->opaque.size == b->opaque.size && (a->opaque.size == 0 || memcmp(a->opaque.p, b->opaque.p, a->opaque.size) == 0);
+}
+
+static void merge_write_opaque(void *file, const struct EntryBuffer *entries, size_t begin, size_t end)
+{
+    if (end > begin) fwrite(entries->opaque.p + begin, 1, end - begin, file);
+}
+
+static size_t merge_skip_added(size_t position, const struct EntryBuffer *ours, const size_t *ours_base, const size_t *ours_theirs)
+{
+    //Entries only ours added right after position
+    while (position < ours->size && ours_base[position] == SIZE_MAX && ours_theirs[position] == SIZE_MAX) position++;
+    return position;
+}
+
+size_t merge_write(void *file, const struct EntryBuffer *base, const struct EntryBuffer *ours, const struct EntryBuffer *theirs)
+{
+    //Lines other than tasks are taken from the side that changed them
+    const bool ours_layout = merge_same_layout(ours, base);
+    const bool theirs_layout = merge_same_layout(theirs, base);
+    const bool same_layout = merge_same_layout(ours, theirs);
+    if (!ours_layout && !theirs_layout && !same_layout) kpd_error(ERR_CONFLICT, "lines other than tasks changed on both sides");
+    const bool swapped = ours_layout && !theirs_layout;
+    if (swapped)
+    {
+        const struct EntryBuffer *swap = ours;
+        ours = theirs;
+        theirs = swap;
+    }
+
+    //Match both sides to base, then entries added on both sides to each other
+    size_t *ours_base = malloc((ours->size + 1) * sizeof(*ours_base));
+    size_t *base_ours = malloc((base->size + 1) * sizeof(*base_ours));
+    size_t *theirs_base = malloc((theirs->size + 1) * sizeof(*theirs_base));
+    size_t *base_theirs = malloc((base->size + 1) * sizeof(*base_theirs));
+    size_t *ours_theirs = malloc((ours->size + 1) * sizeof(*ours_theirs));
+    size_t *theirs_ours = malloc((theirs->size + 1) * sizeof(*theirs_ours));
+    if (ours_base == NULL || base_ours == NULL || theirs_base == NULL || base_theirs == NULL || ours_theirs == NULL || theirs_ours == NULL)
+        kpd_error(ERR_MALLOC, "malloc() failed");
+    struct MergeIndex index = { 0 };
+    merge_index(&index, base, NULL);
+    merge_match(ours_base, base_ours, &index, base, ours);
+    merge_match(theirs_base, base_theirs, &index, base, theirs);
+    merge_index_finalize(&index);
+    merge_index(&index, ours, ours_base);
+    for (size_t i = 0; i < ours->size; i++) ours_theirs[i] = SIZE_MAX;
+    for (size_t i = 0; i < theirs->size; i++)
+    {
+        theirs_ours[i] = (theirs_base[i] == SIZE_MAX) ? merge_lookup(&index, theirs->p[i].description) : SIZE_MAX;
+        if (theirs_ours[i] != SIZE_MAX) ours_theirs[theirs_ours[i]] = i;
+    }
+    merge_index_finalize(&index);
+
+    //Entries only theirs has to write go after the last preceding entry both have, counting sort by that position,
+    //additions of ours at the same position come first (layout side is theirs if swapped, its additions go last anyway)
+    size_t *positions = calloc(ours->size + 2, sizeof(*positions));
+    size_t *extras = malloc((theirs->size + 1) * sizeof(*extras));
+    if (positions == NULL || extras == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    size_t position = swapped ? 0 : merge_skip_added(0, ours, ours_base, ours_theirs);
+    for (size_t i = 0; i < theirs->size; i++)
+    {
+        const size_t j = theirs_base[i];
+        const size_t counterpart = (j != SIZE_MAX) ? base_ours[j] : theirs_ours[i];
+        extras[i] = SIZE_MAX;
+        if (counterpart != SIZE_MAX) position = swapped ? (counterpart + 1) : merge_skip_added(counterpart + 1, ours, ours_base, ours_theirs);
+        else if (j == SIZE_MAX || !merge_equal(&theirs->p[i], &base->p[j])) extras[i] = position;
+        if (extras[i] != SIZE_MAX) positions[extras[i] + 1]++;
+    }
+    for (size_t k = 1; k <= ours->size + 1; k++) positions[k] += positions[k - 1];
+    size_t *order = malloc((theirs->size + 1) * sizeof(*order));
+    if (order == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < theirs->size; i++)
+    {
+        if (extras[i] != SIZE_MAX) order[positions[extras[i]]++] = i;
+    }
+
+    //Write in one pass over layout, position k ends where position k + 1 begins now
+    size_t conflicts = 0;
+    size_t opaque_written = 0;
+    size_t extra = 0;
+    for (size_t k = 0; k <= ours->size; k++)
+    {
+        if (k > 0)
+        {
+            //Entry of layout side
+            const size_t i = k - 1;
+            const struct Entry *entry = &ours->p[i];
+            const size_t j = ours_base[i];
+            const struct Entry *base_entry = (j != SIZE_MAX) ? &base->p[j] : NULL;
+            const size_t t = (j != SIZE_MAX) ? base_theirs[j] : ours_theirs[i];
+            const struct Entry *theirs_entry = (t != SIZE_MAX) ? &theirs->p[t] : NULL;
+            merge_write_opaque(file, ours, opaque_written, entry->offset);
+            opaque_written = entry->offset;
+            struct Entry merged;
+            if (theirs_entry == NULL && base_entry == NULL) kpd_write_entry(file, entry);
+            else if (theirs_entry == NULL && merge_equal(entry, base_entry)) {}
+            else if (theirs_entry != NULL && merge_fields(&merged, base_entry, entry, theirs_entry)) kpd_write_entry(file, &merged);
+            else
+            {
+                merge_conflict(file, entry, theirs_entry, swapped);
+                conflicts++;
+            }
+        }
+        else if (ours->size > 0)
+        {
+            //Entries before first entry of layout side follow lines before it
+            merge_write_opaque(file, ours, 0, ours->p[0].offset);
+            opaque_written = ours->p[0].offset;
+        }
+        else
+        {
+            merge_write_opaque(file, ours, 0, ours->opaque.size);
+            opaque_written = ours->opaque.size;
+        }
+
+        //Entries of other side
+        for (; extra < positions[k]; extra++)
+        {
+            const size_t i = order[extra];
+            if (theirs_base[i] == SIZE_MAX)
+            {
+                kpd_write_entry(file, &theirs->p[i]);
+                continue;
+            }
+            merge_conflict(file, NULL, &theirs->p[i], swapped);
+            conflicts++;
+        }
+    }
+    merge_write_opaque(file, ours, opaque_written, ours->opaque.size);
+
+    //Cleanup
+    free(order);
+    free(extras);
+    free(positions);
+    free(theirs_ours);
+    free(ours_theirs);
+    free(base_theirs);
+    free(theirs_base);
+    free(base_ours);
+    free(ours_base);
+    return conflicts;
+}
@@ -0,0 +1,361 @@
+#include "kpd.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+///Visible row of picker
+struct PickRow
+{
+    size_t index;   ///< Index of entry in store
+    int score;      ///< Score of description against query
+};
+
+///State of picker, candidates of every query length are a prefix of candidates of the shorter query
+struct Picker
+{
+    const struct EntryStore *store; ///< Store of entries
+    size_t *candidates;             ///< Indices of candidates, every level ascending after rescoring
+    size_t *spare;                  ///< Removed candidates while filtering, merged candidates while shrinking
+    size_t *levels;                 ///< Number of candidates for every length of query
+    size_t levels_capacity;         ///< Allocated size of levels
+    struct CharBuffer query;        ///< Query in lower case
+    struct PickRow *rows;           ///< Best candidates, kept as heap while filtering, best first afterwards
+    size_t rows_size;
+    size_t rows_capacity;           ///< Number of visible rows
+    size_t cursor;                  ///< Row under cursor
+    char *marked;                   ///< Entries marked with Tab
+    size_t marked_size;             ///< Number of marked entries
+};
+
+//Terminal state, restored at exit
+static int pick_tty = -1;
+static struct termios pick_termios;
+
+//Needed by pick_run
+static void pick_restore(void)
+{
+    if (pick_tty < 0) return;
+    const char *leave = "\x1b[?1049l";
+    if (write(pick_tty, leave, strlen(leave)) < 0) { /*nothing to do at exit*/ }
+    tcsetattr(pick_tty, TCSAFLUSH, &pick_termios);
+    close(pick_tty);
+    pick_tty = -1;
+}
+
+//Needed by pick_score and pick_append
+static char pick_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+//Needed by pick_filter
+static bool pick_score(int *score, const char *description, const char *query, size_t query_size)
+{
+    //Characters of query in order ignoring case, word beginnings and runs score more, gaps less
+    int result = 0;
+    size_t matched = 0;
+    bool run = false;
+    for (const char *c = description; *c != '\0' && matched < query_size; c++)
+    {
+        if (pick_lower(*c) != query[matched])
+        {
+            if (matched > 0) result--;
+            run = false;
+            continue;
+        }
+        result += 16;
+        if (c == description || c[-1] == ' ' || c[-1] == '-' || c[-1] == '_' || c[-1] == '/' || c[-1] == '+' || c[-1] == '@') result += 8;
+        if (run) result += 12;
+        run = true;
+        matched++;
+    }
+    *score = result;
+    return matched == query_size;
+}
+
+static bool pick_better(const struct Picker *picker, const struct PickRow *a, const struct PickRow *b)
+{
+    //Higher score, then higher priority, then earlier entry
+    if (a->score != b->score) return a->score > b->score;
+    const unsigned int priority_a = picker->store->flags[a->index] & FLAG_PRIORITY;
+    const unsigned int priority_b = picker->store->flags[b->index] & FLAG_PRIORITY;
+    if (priority_a != priority_b) return priority_a > priority_b;
+    return a->index < b->index;
+}
+
+static void pick_sift_down(struct Picker *picker, size_t position, size_t size)
+{
+    //Worst row at root
+    while (true)
+    {
+        size_t worst = position;
+        const size_t left = 2 * position + 1;
+        const size_t right = left + 1;
+        if (left < size && pick_better(picker, &picker->rows[worst], &picker->rows[left])) worst = left;
+        if (right < size && pick_better(picker, &picker->rows[worst], &picker->rows[right])) worst = right;
+        if (worst == position) return;
+        const struct PickRow swap = picker->rows[position];
+        picker->rows[position] = picker->rows[worst];
+        picker->rows[worst] = swap;
+        position = worst;
+    }
+}
+
+static void pick_push(struct Picker *picker, const struct PickRow *row)
+{
+    //Bounded heap keeps visible rows only
+    if (picker->rows_size < picker->rows_capacity)
+    {
+        size_t position = picker->rows_size++;
+        picker->rows[position] = *row;
+        while (position > 0)
+        {
+            const size_t parent = (position - 1) / 2;
+            if (!pick_better(picker, &picker->rows[parent], &picker->rows[position])) break;
+            const struct PickRow swap = picker->rows[position];
+            picker->rows[position] = picker->rows[parent];
+            picker->rows[parent] = swap;
+            position = parent;
+        }
+    }
+    else if (picker->rows_capacity > 0 && pick_better(picker, row, &picker->rows[0]))
+    {
+        picker->rows[0] = *row;
+        pick_sift_down(picker, 0, picker->rows_size);
+    }
+}
+
+//Needed by pick_append, pick_shrink and pick_run
+static void pick_filter(struct Picker *picker, size_t size)
+{
+    //Rescore first size candidates in order of descriptions in blob, matches stay in front
+    const struct EntryStore *store = picker->store;
+    size_t kept = 0, removed = 0;
+    picker->rows_size = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        const size_t index = picker->candidates[i];
+        struct PickRow row = { index, 0 };
+        if (pick_score(&row.score, store->blob.p + store->offsets[index], picker->query.p, picker->query.size))
+        {
+            picker->candidates[kept++] = index;
+            pick_push(picker, &row);
+        }
+        else picker->spare[removed++] = index;
+    }
+    memcpy(picker->candidates + kept, picker->spare, removed * sizeof(*picker->candidates));
+    picker->levels[picker->query.size] = kept;
+
+    //Heap to rows, best first
+    for (size_t heap_size = picker->rows_size; heap_size > 1; heap_size--)
+    {
+        const struct PickRow swap = picker->rows[0];
+        picker->rows[0] = picker->rows[heap_size - 1];
+        picker->rows[heap_size - 1] = swap;
+        pick_sift_down(picker, 0, heap_size - 1);
+    }
+    if (picker->cursor >= picker->rows_size) picker->cursor = (picker->rows_size == 0) ? 0 : (picker->rows_size - 1);
+}
+
+//Needed by pick_run
+static void pick_append(struct Picker *picker, char c)
+{
+    //Longer query only rescores candidates of shorter one
+    const char lower = pick_lower(c);
+    string_substitute(&picker->query, picker->query.size, 0, &lower, 1);
+    if (picker->query.size + 1 > picker->levels_capacity)
+    {
+        size_t new_capacity = 2 * picker->levels_capacity;
+        while (picker->query.size + 1 > new_capacity) new_capacity <<= 1;
+        size_t *new_levels = realloc(picker->levels, new_capacity * sizeof(*picker->levels));
+        if (new_levels == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        picker->levels = new_levels;
+        picker->levels_capacity = new_capacity;
+    }
+    pick_filter(picker, picker->levels[picker->query.size - 1]);
+}
+
+static void pick_shrink(struct Picker *picker, size_t size)
+{
+    //Candidates removed by every dropped character are merged back in ascending order
+    while (picker->query.size > size)
+    {
+        const size_t level = picker->query.size;
+        const size_t *a = picker->candidates, *a_end = picker->candidates + picker->levels[level];
+        const size_t *b = a_end, *b_end = picker->candidates + picker->levels[level - 1];
+        size_t *out = picker->spare;
+        while (a < a_end && b < b_end) *out++ = (*a < *b) ? *a++ : *b++;
+        while (a < a_end) *out++ = *a++;
+        while (b < b_end) *out++ = *b++;
+        memcpy(picker->candidates, picker->spare, picker->levels[level - 1] * sizeof(*picker->candidates));
+        string_set_size(&picker->query, level - 1);
+    }
+    pick_filter(picker, picker->levels[picker->query.size]);
+}
+
+static void pick_draw(const struct Picker *picker, struct CharBuffer *frame, unsigned int width)
+{
+    //Query with number of matches, then rows, cursor at end of query
+    string_set_size(frame, 0);
+    char line[64];
+    string_substitute(frame, frame->size, 0, "\x1b[H> ", strlen("\x1b[H> "));
+    string_substitute(frame, frame->size, 0, picker->query.p, picker->query.size);
+    snprintf(line, sizeof(line), "  \x1b[2m%u/%u\x1b[0m\x1b[K",
+        (unsigned int)picker->levels[picker->query.size], (unsigned int)picker->levels[0]);
+    string_substitute(frame, frame->size, 0, line, strlen(line));
+    for (size_t i = 0; i < picker->rows_size; i++)
+    {
+        const size_t index = picker->rows[i].index;
+        const int prefix_length = snprintf(line, sizeof(line), "\r\n%s%c %u. ",
+            (i == picker->cursor) ? "\x1b[7m" : "", picker->marked[index] ? '*' : ' ', (unsigned int)(index + 1));
+        string_substitute(frame, frame->size, 0, line, (size_t)prefix_length);
+
+        //Description cut to width, not inside UTF-8 sequence
+        const char *description = picker->store->blob.p + picker->store->offsets[index];
+        const unsigned int used = (unsigned int)prefix_length - 2 - ((i == picker->cursor) ? 4 : 0);
+        unsigned int columns = 0;
+        size_t size = 0;
+        for (; description[size] != '\0'; size++)
+        {
+            if ((description[size] & 0xC0) == 0x80) continue;
+            if (used + columns >= width) break;
+            columns++;
+        }
+        string_substitute(frame, frame->size, 0, description, size);
+        string_substitute(frame, frame->size, 0, "\x1b[0m\x1b[K", strlen("\x1b[0m\x1b[K"));
+    }
+    unsigned int query_columns = 0;
+    for (size_t i = 0; i < picker->query.size; i++) query_columns += (picker->query.p[i] & 0xC0) != 0x80;
+    snprintf(line, sizeof(line), "\x1b[J\x1b[1;%uH", query_columns + 3);
+    string_substitute(frame, frame->size, 0, line, strlen(line));
+}
+
+static bool pick_read(char *c, bool wait)
+{
+    //Escape sequences arrive at once, lone escape does not
+    if (!wait)
+    {
+        struct pollfd descriptor = { pick_tty, POLLIN, 0 };
+        if (poll(&descriptor, 1, 25) <= 0) return false;
+    }
+    const ssize_t size = read(pick_tty, c, 1);
+    if (size < 0) kpd_error(ERR_TERMINAL, "read() failed");
+    return size == 1;
+}
+
+size_t pick_run(char *mask, const struct EntryStore *store)
+{
+    //Candidates are entries in mask
+    struct Picker picker = { 0 };
+    picker.store = store;
+    picker.candidates = malloc((store->size + 1) * sizeof(*picker.candidates));
+    picker.spare = malloc((store->size + 1) * sizeof(*picker.spare));
+    picker.levels = malloc(16 * sizeof(*picker.levels));
+    picker.marked = calloc(store->size + 1, 1);
+    if (picker.candidates == NULL || picker.spare == NULL || picker.levels == NULL || picker.marked == NULL)
+        kpd_error(ERR_MALLOC, "malloc() failed");
+    picker.levels_capacity = 16;
+    size_t size = 0;
+    for (size_t i = 0; i < store->size; i++)
+    {
+        if (mask[i]) picker.candidates[size++] = i;
+    }
+    picker.levels[0] = size;
+    string_set_size(&picker.query, 0);
+
+    //Raw terminal on alternate screen, standard streams stay free for output
+    pick_tty = open("/dev/tty", O_RDWR | O_CLOEXEC);
+    if (pick_tty < 0) kpd_error(ERR_TERMINAL, "terminal is not available");
+    if (tcgetattr(pick_tty, &pick_termios) < 0) kpd_error(ERR_TERMINAL, "tcgetattr() failed");
+    atexit(pick_restore);
+    struct termios raw = pick_termios;
+    raw.c_lflag &= ~(tcflag_t)(ECHO | ICANON | ISIG | IEXTEN);
+    raw.c_iflag &= ~(tcflag_t)(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(pick_tty, TCSAFLUSH, &raw) < 0) kpd_error(ERR_TERMINAL, "tcsetattr() failed");
+    const char *enter = "\x1b[?1049h";
+    if (write(pick_tty, enter, strlen(enter)) < 0) kpd_error(ERR_TERMINAL, "write() failed");
+
+    //Redraw after every key, rows follow terminal height
+    struct CharBuffer frame = { 0 };
+    bool accepted = false;
+    while (true)
+    {
+        struct winsize window = { 24, 80, 0, 0 };
+        if (ioctl(pick_tty, TIOCGWINSZ, &window) < 0 || window.ws_row < 2 || window.ws_col < 8) window = (struct winsize){ 24, 80, 0, 0 };
+        const size_t rows_capacity = (size_t)window.ws_row - 1;
+        if (rows_capacity != picker.rows_capacity)
+        {
+            struct PickRow *new_rows = realloc(picker.rows, rows_capacity * sizeof(*picker.rows));
+            if (new_rows == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+            picker.rows = new_rows;
+            picker.rows_capacity = rows_capacity;
+            pick_filter(&picker, picker.levels[picker.query.size]);
+        }
+        pick_draw(&picker, &frame, window.ws_col);
+        if (write(pick_tty, frame.p, frame.size) < 0) kpd_error(ERR_TERMINAL, "write() failed");
+
+        //Keys
+        char c;
+        if (!pick_read(&c, true) || c == 0x03 || c == 0x04 || c == 0x07) break;
+        if (c == '\r' || c == '\n')
+        {
+            accepted = picker.rows_size > 0 || picker.marked_size > 0;
+            if (accepted) break;
+        }
+        else if (c == '\t' && picker.rows_size > 0)
+        {
+            char *marked = &picker.marked[picker.rows[picker.cursor].index];
+            *marked = (char)!*marked;
+            picker.marked_size = *marked ? (picker.marked_size + 1) : (picker.marked_size - 1);
+            if (picker.cursor + 1 < picker.rows_size) picker.cursor++;
+        }
+        else if (c == 0x0E && picker.cursor + 1 < picker.rows_size) picker.cursor++;
+        else if (c == 0x10 && picker.cursor > 0) picker.cursor--;
+        else if ((c == 0x7F || c == 0x08) && picker.query.size > 0)
+        {
+            size_t new_size = picker.query.size - 1;
+            while (new_size > 0 && (picker.query.p[new_size] & 0xC0) == 0x80) new_size--;
+            pick_shrink(&picker, new_size);
+        }
+        else if (c == 0x15) pick_shrink(&picker, 0);
+        else if (c == 0x1B)
+        {
+            //Arrows move cursor, other sequences are skipped
+            char sequence;
+            if (!pick_read(&sequence, false)) break;
+            if (sequence != '[' && sequence != 'O') continue;
+            while (pick_read(&sequence, false) && !(sequence >= 0x40 && sequence <= 0x7E)) {}
+            if (sequence == 'B' && picker.cursor + 1 < picker.rows_size) picker.cursor++;
+            else if (sequence == 'A' && picker.cursor > 0) picker.cursor--;
+        }
+        else if ((unsigned char)c >= 0x20 && c != 0x7F) pick_append(&picker, c);
+    }
+    pick_restore();
+
+    //Marked entries, or entry under cursor
+    size_t picked = 0;
+    for (size_t i = 0; i < store->size; i++)
+    {
+        mask[i] = (char)(accepted && (picker.marked_size > 0 ? picker.marked[i] : i == picker.rows[picker.cursor].index));
+        picked += (size_t)mask[i];
+    }
+
+    //Cleanup
+    free(frame.p);
+    free(picker.query.p);
+    free(picker.candidates);
+    free(picker.spare);
+    free(picker.levels);
+    free(picker.rows);
+    free(picker.marked);
+    return picked;
+}
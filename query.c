@@ -0,0 +1,679 @@
+#include "kpd.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+///Operation of instruction
+enum QueryOpcode
+{
+    QOP_FLAGS,          ///< Value is bit of flag combination in set
+    QOP_CONTAINS,       ///< Value is if description contains string, ignoring case
+    QOP_EQUALS,         ///< Value is if description equals string, ignoring case
+    QOP_TAG,            ///< Value is if description has tag
+    QOP_ID,             ///< Value is if ID of description starts with string
+    QOP_NOT,            ///< Value is negated
+    QOP_JUMP_FALSE,     ///< Continue at argument if value is false
+    QOP_JUMP_TRUE       ///< Continue at argument if value is true
+};
+
+///Kind of node of parsed expression
+enum QueryKind
+{
+    QKD_FLAGS,
+    QKD_CONTAINS,
+    QKD_EQUALS,
+    QKD_TAG,
+    QKD_ID,
+    QKD_NOT,
+    QKD_AND,
+    QKD_OR
+};
+
+///Node of parsed expression, children are linked as siblings
+struct QueryNode
+{
+    enum QueryKind kind;
+    unsigned char flags;    ///< Set of flag combinations (QKD_FLAGS), or if every match needs tag (QKD_TAG)
+    size_t string;          ///< Offset of string (QKD_CONTAINS, QKD_EQUALS, QKD_TAG, QKD_ID)
+    size_t child;           ///< First child, SIZE_MAX for none
+    size_t sibling;         ///< Next child of parent, SIZE_MAX for last
+};
+
+///Kind of token
+enum QueryToken
+{
+    QTK_END,
+    QTK_WORD,
+    QTK_STRING,
+    QTK_OPEN,
+    QTK_CLOSE,
+    QTK_OPERATOR
+};
+
+///State of parser
+struct QueryParser
+{
+    const char *p;              ///< Rest of expression
+    enum QueryToken token;      ///< Current token
+    struct CharBuffer text;     ///< Text of current token
+    struct QueryNode *nodes;
+    size_t size;
+    size_t capacity;
+    struct Query *query;
+};
+
+//Needed by query_parse_or and query_compile
+static void query_next(struct QueryParser *parser)
+{
+    //Skip spaces
+    while (isspace((unsigned char)*parser->p)) parser->p++;
+    string_set_size(&parser->text, 0);
+    const char *begin = parser->p;
+    if (*begin == '\0')
+    {
+        parser->token = QTK_END;
+        return;
+    }
+
+    //Punctuation
+    if (*begin == '(' || *begin == ')')
+    {
+        parser->token = (*begin == '(') ? QTK_OPEN : QTK_CLOSE;
+        string_substitute(&parser->text, 0, 0, begin, 1);
+        parser->p++;
+        return;
+    }
+    if (strchr("=!<>~", *begin) != NULL)
+    {
+        parser->p++;
+        if (*parser->p == '=' || (*begin == '!' && *parser->p == '~')) parser->p++;
+        parser->token = QTK_OPERATOR;
+        string_substitute(&parser->text, 0, 0, begin, (size_t)(parser->p - begin));
+        return;
+    }
+
+    //Quoted string, backslash escapes next character
+    if (*begin == '"')
+    {
+        parser->p++;
+        while (*parser->p != '"')
+        {
+            if (*parser->p == '\\' && parser->p[1] != '\0') parser->p++;
+            if (*parser->p == '\0') kpd_error(ERR_USAGE, "unterminated string in query");
+            string_substitute(&parser->text, parser->text.size, 0, parser->p, 1);
+            parser->p++;
+        }
+        parser->p++;
+        parser->token = QTK_STRING;
+        return;
+    }
+
+    //Word
+    while (*parser->p != '\0' && !isspace((unsigned char)*parser->p) && strchr("()=!<>~\"", *parser->p) == NULL) parser->p++;
+    parser->token = QTK_WORD;
+    string_substitute(&parser->text, 0, 0, begin, (size_t)(parser->p - begin));
+}
+
+static size_t query_node(struct QueryParser *parser, enum QueryKind kind, unsigned char flags)
+{
+    if (parser->size == parser->capacity)
+    {
+        parser->capacity = (parser->capacity == 0) ? 16 : (2 * parser->capacity);
+        struct QueryNode *new_nodes = realloc(parser->nodes, parser->capacity * sizeof(*parser->nodes));
+        if (new_nodes == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        parser->nodes = new_nodes;
+    }
+    struct QueryNode *node = &parser->nodes[parser->size];
+    node->kind = kind;
+    node->flags = flags;
+    node->string = 0;
+    node->child = SIZE_MAX;
+    node->sibling = SIZE_MAX;
+    return parser->size++;
+}
+
+static size_t query_text(struct QueryParser *parser, enum QueryKind kind)
+{
+    //Strings are kept in lower case, matching ignores case
+    if (parser->token != QTK_WORD && parser->token != QTK_STRING) kpd_error(ERR_USAGE, "text expected in query after description operator");
+    const size_t node = query_node(parser, kind, 0);
+    parser->nodes[node].string = parser->query->strings.size;
+    for (size_t i = 0; i < parser->text.size; i++) parser->text.p[i] = (char)tolower((unsigned char)parser->text.p[i]);
+    string_substitute(&parser->query->strings, parser->query->strings.size, 0, parser->text.p, parser->text.size + 1);
+    parser->query->text = true;
+    if (kind == QKD_TAG) parser->query->tags = true;
+    query_next(parser);
+    return node;
+}
+
+static size_t query_wrap(struct QueryParser *parser, enum QueryKind kind, size_t child)
+{
+    const size_t node = query_node(parser, kind, 0);
+    parser->nodes[node].child = child;
+    return node;
+}
+
+//Needed by query_parse_atom, keywords must be spelled out, unlike command line arguments
+static bool query_keyword(size_t *index, const char *word, const char *const *strings, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(word, strings[i]) == 0)
+        {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t query_parse_or(struct QueryParser *parser);
+
+static size_t query_parse_atom(struct QueryParser *parser)
+{
+    //Grouping and negation
+    if (parser->token == QTK_OPEN)
+    {
+        query_next(parser);
+        const size_t node = query_parse_or(parser);
+        if (parser->token != QTK_CLOSE) kpd_error(ERR_USAGE, "')' expected in query");
+        query_next(parser);
+        return node;
+    }
+    if (parser->token == QTK_WORD && strcmp(parser->text.p, "not") == 0)
+    {
+        query_next(parser);
+        return query_wrap(parser, QKD_NOT, query_parse_atom(parser));
+    }
+    if (parser->token == QTK_STRING) return query_text(parser, QKD_CONTAINS);
+    if (parser->token != QTK_WORD) kpd_error(ERR_USAGE, "unexpected '%s' in query", (parser->token == QTK_END) ? "end" : parser->text.p);
+
+    //Comparison of priority
+    if (strcmp(parser->text.p, "priority") == 0)
+    {
+        query_next(parser);
+        if (parser->token != QTK_OPERATOR) kpd_error(ERR_USAGE, "operator expected in query after 'priority'");
+        const char *operators[] = { "=", "==", "!=", "<", "<=", ">", ">=" };
+        size_t operator = 0;
+        while (operator < sizeof(operators)/sizeof(*operators) && strcmp(parser->text.p, operators[operator]) != 0) operator++;
+        if (operator == sizeof(operators)/sizeof(*operators)) kpd_error(ERR_USAGE, "'%s' cannot compare priority in query", parser->text.p);
+        query_next(parser);
+        size_t value;
+        if (parser->token != QTK_WORD || !query_keyword(&value, parser->text.p, kpd_priority_strings, sizeof(kpd_priority_strings)/sizeof(*kpd_priority_strings)))
+            kpd_error(ERR_USAGE, "priority expected in query");
+        query_next(parser);
+        unsigned char priorities = 0;
+        for (unsigned int priority = PRI_LOW; priority <= PRI_CRITICAL; priority++)
+        {
+            const bool match =
+                (operator <= 1) ? (priority == value) :
+                (operator == 2) ? (priority != value) :
+                (operator == 3) ? (priority < value) :
+                (operator == 4) ? (priority <= value) :
+                (operator == 5) ? (priority > value) : (priority >= value);
+            if (match) priorities |= (unsigned char)(1u << priority);
+        }
+        return query_node(parser, QKD_FLAGS, (unsigned char)(priorities | (priorities << 4)));
+    }
+
+    //Matching of description
+    if (strcmp(parser->text.p, "desc") == 0 || strcmp(parser->text.p, "description") == 0)
+    {
+        query_next(parser);
+        if (parser->token != QTK_OPERATOR) kpd_error(ERR_USAGE, "operator expected in query after 'desc'");
+        const bool negated = parser->text.p[0] == '!';
+        const bool contains = parser->text.p[negated ? 1 : 0] == '~';
+        if (parser->text.p[0] == '<' || parser->text.p[0] == '>')
+            kpd_error(ERR_USAGE, "'%s' cannot compare description in query", parser->text.p);
+        query_next(parser);
+        const size_t node = query_text(parser, contains ? QKD_CONTAINS : QKD_EQUALS);
+        return negated ? query_wrap(parser, QKD_NOT, node) : node;
+    }
+
+    //Keywords, tags and @ID, everything else is text
+    if (tag_valid(parser->text.p)) return query_text(parser, QKD_TAG);
+    const size_t id_length = strlen(parser->text.p) - 1;
+    if (parser->text.p[0] == '@' && id_length >= 4 && id_length <= 16 && strspn(parser->text.p + 1, "0123456789abcdef") == id_length)
+    {
+        memmove(parser->text.p, parser->text.p + 1, id_length + 1);
+        parser->text.size = id_length;
+        return query_text(parser, QKD_ID);
+    }
+    size_t status;
+    size_t priority;
+    if (query_keyword(&status, parser->text.p, kpd_status_strings, sizeof(kpd_status_strings)/sizeof(*kpd_status_strings)))
+    {
+        query_next(parser);
+        parser->query->status = true;
+        return query_node(parser, QKD_FLAGS, (status == STA_ALL) ? QUERY_ALL : (status == STA_OPEN) ? QUERY_OPEN : QUERY_DONE);
+    }
+    if (query_keyword(&priority, parser->text.p, kpd_priority_strings, sizeof(kpd_priority_strings)/sizeof(*kpd_priority_strings)))
+    {
+        query_next(parser);
+        return query_node(parser, QKD_FLAGS, (unsigned char)((1u << priority) | (1u << (priority + 4))));
+    }
+    return query_text(parser, QKD_CONTAINS);
+}
+
+static size_t query_parse_and(struct QueryParser *parser)
+{
+    //Juxtaposition also means 'and'
+    const size_t first = query_parse_atom(parser);
+    size_t last = first;
+    size_t node = SIZE_MAX;
+    while (parser->token != QTK_END && parser->token != QTK_CLOSE && !(parser->token == QTK_WORD && strcmp(parser->text.p, "or") == 0))
+    {
+        if (parser->token == QTK_WORD && strcmp(parser->text.p, "and") == 0) query_next(parser);
+        if (node == SIZE_MAX) node = query_wrap(parser, QKD_AND, first);
+        const size_t next = query_parse_atom(parser);
+        parser->nodes[last].sibling = next;
+        last = next;
+    }
+    return (node == SIZE_MAX) ? first : node;
+}
+
+static size_t query_parse_or(struct QueryParser *parser)
+{
+    const size_t first = query_parse_and(parser);
+    size_t last = first;
+    size_t node = SIZE_MAX;
+    while (parser->token == QTK_WORD && strcmp(parser->text.p, "or") == 0)
+    {
+        query_next(parser);
+        if (node == SIZE_MAX) node = query_wrap(parser, QKD_OR, first);
+        const size_t next = query_parse_and(parser);
+        parser->nodes[last].sibling = next;
+        last = next;
+    }
+    return (node == SIZE_MAX) ? first : node;
+}
+
+//Needed by query_compile
+static void query_fold(struct QueryParser *parser, size_t index)
+{
+    //Flag tests of node collapse into one set, it is the first child
+    struct QueryNode *node = &parser->nodes[index];
+    if (node->kind != QKD_NOT && node->kind != QKD_AND && node->kind != QKD_OR) return;
+    for (size_t child = node->child; child != SIZE_MAX; child = parser->nodes[child].sibling) query_fold(parser, child);
+    node = &parser->nodes[index];
+    if (node->kind == QKD_NOT)
+    {
+        const struct QueryNode *child = &parser->nodes[node->child];
+        if (child->kind != QKD_FLAGS) return;
+        node->kind = QKD_FLAGS;
+        node->flags = (unsigned char)~child->flags;
+        node->child = SIZE_MAX;
+        return;
+    }
+    const bool and = node->kind == QKD_AND;
+    unsigned char flags = and ? QUERY_ALL : 0;
+    bool folded = false;
+    size_t rest = SIZE_MAX;
+    size_t *rest_end = &rest;
+    for (size_t child = node->child; child != SIZE_MAX;)
+    {
+        const size_t sibling = parser->nodes[child].sibling;
+        if (parser->nodes[child].kind == QKD_FLAGS)
+        {
+            flags = and ? (unsigned char)(flags & parser->nodes[child].flags) : (unsigned char)(flags | parser->nodes[child].flags);
+            folded = true;
+        }
+        else
+        {
+            *rest_end = child;
+            rest_end = &parser->nodes[child].sibling;
+        }
+        child = sibling;
+    }
+    *rest_end = SIZE_MAX;
+    if (rest == SIZE_MAX)
+    {
+        node->kind = QKD_FLAGS;
+        node->flags = flags;
+        node->child = SIZE_MAX;
+        return;
+    }
+    if (folded)
+    {
+        const size_t set = query_node(parser, QKD_FLAGS, flags);
+        parser->nodes[set].sibling = rest;
+        rest = set;
+    }
+    parser->nodes[index].child = rest;
+}
+
+static unsigned int query_evaluate(const struct QueryParser *parser, size_t index, unsigned int combination)
+{
+    //Three-valued: 0 false, 1 true, 2 depends on description
+    const struct QueryNode *node = &parser->nodes[index];
+    switch (node->kind)
+    {
+    case QKD_FLAGS:
+        return (node->flags >> combination) & 1u;
+    case QKD_CONTAINS:
+    case QKD_EQUALS:
+    case QKD_TAG:
+    case QKD_ID:
+        return 2;
+    case QKD_NOT:
+    {
+        const unsigned int value = query_evaluate(parser, node->child, combination);
+        return (value == 2) ? 2 : (1 - value);
+    }
+    default:
+    {
+        const unsigned int decisive = (node->kind == QKD_AND) ? 0 : 1;
+        unsigned int result = 1 - decisive;
+        for (size_t child = node->child; child != SIZE_MAX; child = parser->nodes[child].sibling)
+        {
+            const unsigned int value = query_evaluate(parser, child, combination);
+            if (value == decisive) return decisive;
+            if (value == 2) result = 2;
+        }
+        return result;
+    }
+    }
+}
+
+static void query_require(struct QueryParser *parser, size_t index)
+{
+    //Tags of conjunction at root are needed by every match
+    struct QueryNode *node = &parser->nodes[index];
+    if (node->kind == QKD_TAG) node->flags = 1;
+    if (node->kind != QKD_AND) return;
+    for (size_t child = node->child; child != SIZE_MAX; child = parser->nodes[child].sibling) query_require(parser, child);
+}
+
+static size_t query_emit(struct Query *query, enum QueryOpcode opcode, unsigned char flags, size_t argument)
+{
+    if (query->size == query->capacity)
+    {
+        query->capacity = (query->capacity == 0) ? 16 : (2 * query->capacity);
+        struct QueryInstruction *new_p = realloc(query->p, query->capacity * sizeof(*query->p));
+        if (new_p == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        query->p = new_p;
+    }
+    struct QueryInstruction *instruction = &query->p[query->size];
+    instruction->opcode = (unsigned char)opcode;
+    instruction->flags = flags;
+    instruction->argument = argument;
+    return query->size++;
+}
+
+static void query_generate(struct Query *query, const struct QueryParser *parser, size_t index)
+{
+    const struct QueryNode *node = &parser->nodes[index];
+    switch (node->kind)
+    {
+    case QKD_FLAGS:
+        query_emit(query, QOP_FLAGS, node->flags, 0);
+        break;
+    case QKD_CONTAINS:
+        query_emit(query, QOP_CONTAINS, 0, node->string);
+        break;
+    case QKD_EQUALS:
+        query_emit(query, QOP_EQUALS, 0, node->string);
+        break;
+    case QKD_TAG:
+        query_emit(query, QOP_TAG, node->flags, node->string);
+        break;
+    case QKD_ID:
+        query_emit(query, QOP_ID, 0, node->string);
+        break;
+    case QKD_NOT:
+        query_generate(query, parser, node->child);
+        query_emit(query, QOP_NOT, 0, 0);
+        break;
+    default:
+    {
+        //Short circuit, jumps are patched to end
+        const enum QueryOpcode jump = (node->kind == QKD_AND) ? QOP_JUMP_FALSE : QOP_JUMP_TRUE;
+        const size_t jumps_begin = query->size;
+        for (size_t child = node->child; child != SIZE_MAX; child = parser->nodes[child].sibling)
+        {
+            query_generate(query, parser, child);
+            if (parser->nodes[child].sibling != SIZE_MAX) query_emit(query, jump, 0, SIZE_MAX);
+        }
+        for (size_t i = jumps_begin; i < query->size; i++)
+        {
+            if (query->p[i].opcode == jump && query->p[i].argument == SIZE_MAX) query->p[i].argument = query->size;
+        }
+        break;
+    }
+    }
+}
+
+//Needed by query_match, query_select and query_select_store
+static bool query_contains(const char *description, const char *string)
+{
+    //String is in lower case
+    const size_t length = strlen(string);
+    for (const char *begin = description; *begin != '\0'; begin++)
+    {
+        size_t i = 0;
+        while (i < length && begin[i] != '\0' && tolower((unsigned char)begin[i]) == string[i]) i++;
+        if (i == length) return true;
+    }
+    return length == 0;
+}
+
+static bool query_equals(const char *description, const char *string)
+{
+    while (*description != '\0' && tolower((unsigned char)*description) == *string)
+    {
+        description++;
+        string++;
+    }
+    return *description == '\0' && *string == '\0';
+}
+
+static bool query_run(const struct Query *query, unsigned int combination, const char *description, const struct TagIndex *index, const size_t *tags, size_t entry)
+{
+    //Tags are looked up in index if there is one
+    bool value = false;
+    for (size_t pc = 0; pc < query->size; pc++)
+    {
+        const struct QueryInstruction *instruction = &query->p[pc];
+        switch ((enum QueryOpcode)instruction->opcode)
+        {
+        case QOP_FLAGS:
+            value = ((instruction->flags >> combination) & 1u) != 0;
+            break;
+        case QOP_CONTAINS:
+            value = query_contains(description, query->strings.p + instruction->argument);
+            break;
+        case QOP_EQUALS:
+            value = query_equals(description, query->strings.p + instruction->argument);
+            break;
+        case QOP_TAG:
+            if (index == NULL) value = tag_contains(description, query->strings.p + instruction->argument);
+            else value = tags[pc] != SIZE_MAX && entry / 64 < index->words[tags[pc]] && ((index->postings[tags[pc]][entry / 64] >> (entry % 64)) & 1u) != 0;
+            break;
+        case QOP_ID:
+        {
+            const char *id = query->strings.p + instruction->argument;
+            value = id_match(description, id, strlen(id));
+            break;
+        }
+        case QOP_NOT:
+            value = !value;
+            break;
+        case QOP_JUMP_FALSE:
+            if (!value) pc = instruction->argument - 1;
+            break;
+        case QOP_JUMP_TRUE:
+            if (value) pc = instruction->argument - 1;
+            break;
+        }
+    }
+    return value;
+}
+
+void query_compile(struct Query *query, int argc, char **argv, bool open)
+{
+    //Arguments are joined like one expression
+    struct CharBuffer expression = { 0 };
+    string_set_size(&expression, 0);
+    for (int i = 0; i < argc; i++)
+    {
+        if (i > 0) string_substitute(&expression, expression.size, 0, " ", 1);
+        string_substitute(&expression, expression.size, 0, argv[i], strlen(argv[i]));
+    }
+
+    //Parse
+    memset(query, 0, sizeof(*query));
+    struct QueryParser parser = { 0 };
+    parser.p = expression.p;
+    parser.query = query;
+    string_set_size(&parser.text, 0);
+    query_next(&parser);
+    size_t root = (parser.token == QTK_END) ? query_node(&parser, QKD_FLAGS, QUERY_ALL) : query_parse_or(&parser);
+    if (parser.token != QTK_END) kpd_error(ERR_USAGE, "unexpected '%s' in query", parser.text.p);
+
+    //Open tasks only, unless done state is mentioned
+    if (open && !query->status)
+    {
+        const size_t set = query_node(&parser, QKD_FLAGS, QUERY_OPEN);
+        parser.nodes[set].sibling = root;
+        root = query_wrap(&parser, QKD_AND, set);
+    }
+
+    //Fold flag tests, find combinations that can match at all
+    query_fold(&parser, root);
+    for (unsigned int combination = 0; combination < 8; combination++)
+    {
+        if (query_evaluate(&parser, root, combination) != 0) query->flags |= (unsigned char)(1u << combination);
+    }
+
+    //Generate program
+    query_require(&parser, root);
+    query_generate(query, &parser, root);
+
+    //Cleanup
+    free(parser.nodes);
+    free(parser.text.p);
+    free(expression.p);
+}
+
+bool query_match(const struct Query *query, unsigned char flags, const char *description)
+{
+    //Flags decide alone unless descriptions are tested
+    const unsigned int combination = ((flags & FLAG_DONE) ? 4u : 0u) | (flags & FLAG_PRIORITY);
+    if (((query->flags >> combination) & 1u) == 0) return false;
+    if (!query->text) return true;
+    return query_run(query, combination, description, NULL, NULL, 0);
+}
+
+size_t query_select(char *mask, const struct Query *query, const struct EntryBuffer *entries)
+{
+    //Tags are tested on index of all entries
+    if (query->tags)
+    {
+        struct EntryStore store = { 0 };
+        for (size_t i = 0; i < entries->size; i++) store_push(&store, &entries->p[i]);
+        const size_t selected = query_select_store(mask, query, &store);
+        store_finalize(&store);
+        return selected;
+    }
+    size_t selected = 0;
+    for (size_t i = 0; i < entries->size; i++)
+    {
+        const struct Entry *entry = &entries->p[i];
+        const unsigned char flags = (unsigned char)(entry->priority | (entry->done ? FLAG_DONE : 0));
+        mask[i] = query_match(query, flags, entry->description) ? '\1' : '\0';
+        selected += (size_t)mask[i];
+    }
+    return selected;
+}
+
+//Needed by query_select_store
+static size_t query_select_flags(char *mask, const struct Query *query, const struct EntryStore *store)
+{
+    //Vector selection of every (done, priority) pair in set, all priorities of a state in one pass, first pass writes mask itself
+    char *pair = malloc(store->size + 1);
+    if (pair == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    memset(mask, 0, store->size);
+    bool first = true;
+    for (unsigned int done = 0; done < 2; done++)
+    {
+        const unsigned int priorities = (query->flags >> (4 * done)) & 0x0Fu;
+        const unsigned char done_flag = done ? FLAG_DONE : 0;
+        for (unsigned int priority = PRI_LOW; priority <= PRI_CRITICAL; priority++)
+        {
+            if (((priorities >> priority) & 1u) == 0) continue;
+            char *target = first ? mask : pair;
+            if (priorities == 0x0Fu) store_select(target, store, FLAG_DONE, done_flag);
+            else store_select(target, store, FLAG_DONE | FLAG_PRIORITY, (unsigned char)(done_flag | priority));
+            if (!first) for (size_t i = 0; i < store->size; i++) mask[i] |= pair[i];
+            first = false;
+            if (priorities == 0x0Fu) break;
+        }
+    }
+    free(pair);
+    size_t selected = 0;
+    for (size_t i = 0; i < store->size; i++) selected += (size_t)mask[i];
+    return selected;
+}
+
+size_t query_select_store(char *mask, const struct Query *query, const struct EntryStore *store)
+{
+    if (!query->text) return query_select_flags(mask, query, store);
+    size_t selected = 0;
+    if (!query->tags)
+    {
+        for (size_t i = 0; i < store->size; i++)
+        {
+            mask[i] = query_match(query, store->flags[i], store->blob.p + store->offsets[i]) ? '\1' : '\0';
+            selected += (size_t)mask[i];
+        }
+        return selected;
+    }
+
+    //Tags resolve once, bitsets of tags every match needs are intersected into candidates
+    const size_t words = (store->size + 63) / 64;
+    size_t *tags = malloc((query->size + 1) * sizeof(*tags));
+    uint64_t *candidates = malloc((words + 1) * sizeof(*candidates));
+    if (tags == NULL || candidates == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t w = 0; w < words; w++) candidates[w] = UINT64_MAX;
+    if (store->size % 64 != 0) candidates[words - 1] = ((uint64_t)1 << (store->size % 64)) - 1;
+    for (size_t pc = 0; pc < query->size; pc++)
+    {
+        if (query->p[pc].opcode != QOP_TAG) continue;
+        const size_t tag = tag_find(&store->tags, query->strings.p + query->p[pc].argument);
+        tags[pc] = tag;
+        if (!query->p[pc].flags) continue;
+        for (size_t w = 0; w < words; w++)
+        {
+            if (tag == SIZE_MAX || w >= store->tags.words[tag]) candidates[w] = 0;
+            else candidates[w] &= store->tags.postings[tag][w];
+        }
+    }
+
+    //Program runs only on candidates, tag tests are bit tests
+    memset(mask, 0, store->size);
+    for (size_t w = 0; w < words; w++)
+    {
+        for (uint64_t bits = candidates[w]; bits != 0; bits &= bits - 1)
+        {
+            const size_t i = 64 * w + (size_t)__builtin_ctzll(bits);
+            const unsigned int combination = ((store->flags[i] & FLAG_DONE) ? 4u : 0u) | (store->flags[i] & FLAG_PRIORITY);
+            if (((query->flags >> combination) & 1u) == 0) continue;
+            mask[i] = query_run(query, combination, store->blob.p + store->offsets[i], &store->tags, tags, i) ? '\1' : '\0';
+            selected += (size_t)mask[i];
+        }
+    }
+
+    //Cleanup
+    free(candidates);
+    free(tags);
+    return selected;
+}
+
+void query_finalize(struct Query *query)
+{
+    free(query->p);
+    free(query->strings.p);
+    memset(query, 0, sizeof(*query));
+}
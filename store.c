@@ -0,0 +1,116 @@
+#include "kpd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+///Sixteen flags compared at once
+typedef unsigned char FlagVector __attribute__((vector_size(16)));
+///Result of comparison of FlagVector, all bits set in matching bytes
+typedef signed char MatchVector __attribute__((vector_size(16)));
+
+//Needed by store_push
+static void store_set_size(struct EntryStore *store, size_t size)
+{
+    if (size > store->capacity)
+    {
+        size_t new_capacity = (store->capacity == 0) ? 1 : store->capacity;
+        while (size > new_capacity) new_capacity <<= 1;
+        unsigned char *new_flags = realloc(store->flags, new_capacity * sizeof(*store->flags));
+        if (new_flags == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        store->flags = new_flags;
+        size_t *new_offsets = realloc(store->offsets, new_capacity * sizeof(*store->offsets));
+        if (new_offsets == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        store->offsets = new_offsets;
+        unsigned int *new_dues = realloc(store->dues, new_capacity * sizeof(*store->dues));
+        if (new_dues == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        store->dues = new_dues;
+        store->capacity = new_capacity;
+    }
+    store->size = size;
+}
+
+//Needed by store_select
+static MatchVector store_match(const unsigned char *flags, unsigned char flags_mask, unsigned char flags_value)
+{
+    FlagVector vector;
+    memcpy(&vector, flags, sizeof(vector));
+    return (vector & flags_mask) == flags_value;
+}
+
+//Needed by store_sort
+static size_t store_key(unsigned char flags)
+{
+    //Open entries first, then by priority
+    const size_t priority = flags & FLAG_PRIORITY;
+    return (flags & FLAG_DONE) ? (7 - priority) : (3 - priority);
+}
+
+void store_push(struct EntryStore *store, const struct Entry *entry)
+{
+    const size_t index = store->size;
+    store_set_size(store, index + 1);
+    store->flags[index] = (unsigned char)((unsigned char)entry->priority
+        | (entry->priority_explicit ? FLAG_EXPLICIT : 0)
+        | (entry->done ? FLAG_DONE : 0));
+    store->offsets[index] = store->blob.size;
+    store->dues[index] = entry->due;
+    string_substitute(&store->blob, store->blob.size, 0, entry->description, strlen(entry->description) + 1);
+    tag_push(&store->tags, entry->description, index);
+}
+
+void store_finalize(struct EntryStore *store)
+{
+    free(store->flags);
+    free(store->offsets);
+    free(store->dues);
+    free(store->blob.p);
+    tag_finalize(&store->tags);
+    memset(store, 0, sizeof(*store));
+}
+
+void store_select(char *mask, const struct EntryStore *store, unsigned char flags_mask, unsigned char flags_value)
+{
+    size_t i = 0;
+    for (; i + sizeof(FlagVector) <= store->size; i += sizeof(FlagVector))
+    {
+        const MatchVector selected = store_match(store->flags + i, flags_mask, flags_value) & (signed char)1;
+        memcpy(mask + i, &selected, sizeof(selected));
+    }
+    for (; i < store->size; i++) mask[i] = (char)((store->flags[i] & flags_mask) == flags_value);
+}
+
+void store_sort(size_t *order, const struct EntryStore *store)
+{
+    //Counting sort is stable, so numbers stay ascending
+    size_t counts[8] = { 0 };
+    for (size_t i = 0; i < store->size; i++) counts[store_key(store->flags[i])]++;
+    size_t positions[8];
+    size_t position = 0;
+    for (size_t key = 0; key < 8; key++)
+    {
+        positions[key] = position;
+        position += counts[key];
+    }
+    for (size_t i = 0; i < store->size; i++)
+    {
+        order[positions[store_key(store->flags[i])]++] = i;
+    }
+}
+
+void store_view(struct EntryBuffer *entries, const struct EntryStore *store, const size_t *order, const char *mask)
+{
+    for (size_t k = 0; k < store->size; k++)
+    {
+        const size_t i = (order == NULL) ? k : order[k];
+        if (mask != NULL && !mask[i]) continue;
+        entries_set_size(entries, entries->size + 1);
+        struct Entry *entry = &entries->p[entries->size - 1];
+        entry->archived = (store->flags[i] & FLAG_ARCHIVED) != 0;
+        entry->number = entry->archived ? (i - store->archived) : i;
+        entry->description = store->blob.p + store->offsets[i];
+        entry->priority = (enum Priority)(store->flags[i] & FLAG_PRIORITY);
+        entry->priority_explicit = (store->flags[i] & FLAG_EXPLICIT) != 0;
+        entry->done = (store->flags[i] & FLAG_DONE) != 0;
+        entry->due = store->dues[i];
+    }
+}
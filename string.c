@@ -1,5 +1,9 @@
 #include "kpd.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -53,20 +57,25 @@ bool string_set_line(struct CharBuffer *string, void *file)
         }
         else
         {
-            const char *endline = memchr(string->p, '\n', string->capacity - 1);
-            if (endline == NULL)
+            const size_t size = string->size + strlen(string->p + string->size); //Meaningful read symbols
+            const char *endline = memchr(string->p + string->size, '\n', size - string->size);
+            if (endline != NULL)
             {
-                //Endline not read, try again
-                const size_t size = string->capacity - 1; //Meaningful read symbols
-                string->size = size;
-                string_set_size(string, 2 * size);
+                //Endline read, can parse
+                string->size = (size_t)(endline - string->p) + 1; //String is one longer than endline
+                return true;
+            }
+            else if (size + 1 < string->capacity)
+            {
+                //Last line without endline, next fgets() fails
                 string->size = size;
             }
             else
             {
-                //Endline read, can parse
-                string->size = (size_t)(endline - string->p) + 1; //String is one longer than endline
-                return true;
+                //Endline not read, try again
+                string->size = size;
+                string_set_size(string, 2 * size);
+                string->size = size;
             }
         }
     }    
@@ -95,6 +104,42 @@ void string_set_input(struct CharBuffer *string, const char *prompt, const char
     string_trim(string, 0, 0);
 }
 
+void string_append_stream(struct CharBuffer *string, void *file)
+{
+    size_t size = string->size;
+    while (true)
+    {
+        if (size == string->size) string_set_size(string, 2 * size + INITIAL_BUFFER_SIZE);
+        const size_t result = fread(string->p + size, 1, string->size - size, file);
+        size += result;
+        if (result == 0) break;
+    }
+    if (ferror(file)) kpd_error(ERR_READ, "fread() failed");
+    string_set_size(string, size);
+}
+
+bool string_set_file(struct CharBuffer *string, const char *path)
+{
+    const int file = open(path, O_RDONLY);
+    if (file < 0) return false;
+    struct stat status;
+    if (fstat(file, &status) < 0) kpd_error(ERR_READ, "fstat() failed");
+    string_set_size(string, (size_t)status.st_size + 1); //One spare byte to see the end of file
+    size_t size = 0;
+    while (true)
+    {
+        //File may grow or shrink while reading
+        if (size == string->size) string_set_size(string, 2 * size + INITIAL_BUFFER_SIZE);
+        const ssize_t result = read(file, string->p + size, string->size - size);
+        if (result < 0) kpd_error(ERR_READ, "read() failed");
+        if (result == 0) break;
+        size += (size_t)result;
+    }
+    string_set_size(string, size);
+    close(file);
+    return true;
+}
+
 void string_set_cwd(struct CharBuffer *path)
 {
     string_set_size(path, INITIAL_BUFFER_SIZE);
@@ -131,7 +176,7 @@ void string_substitute(struct CharBuffer *string, size_t segment_begin, size_t s
             string_set_size(string, new_size);
         }
         segment_p = string->p + segment_begin;
-        memmove(segment_p + substitution_size, segment_p + segment_size, old_size - segment_begin);
+        memmove(segment_p + substitution_size, segment_p + segment_size, old_size - segment_begin - segment_size);
         memcpy(segment_p, substitution, substitution_size);
         if (substitution_size < segment_size)
         {
@@ -200,6 +245,39 @@ void string_trim(struct CharBuffer *string, size_t beginning_spaces, size_t endi
     string->p[string->size] = '\0';
 }
 
+void string_normalize(struct CharBuffer *string, const char *description)
+{
+    //Lower case, single spaces, no trailing punctuation
+    string_set_size(string, strlen(description));
+    size_t size = 0;
+    bool space = false;
+    for (const char *c = description; *c != '\0'; c++)
+    {
+        if (isspace((unsigned char)*c))
+        {
+            space = size > 0;
+            continue;
+        }
+        if (space) string->p[size++] = ' ';
+        space = false;
+        string->p[size++] = (char)tolower((unsigned char)*c);
+    }
+    while (size > 0 && strchr(" .,;:!?", string->p[size - 1]) != NULL) size--;
+    string_set_size(string, size);
+}
+
+uint64_t string_hash(const char *p, size_t size)
+{
+    //FNV-1a
+    uint64_t hash = 0xCBF29CE484222325u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)p[i];
+        hash *= 0x100000001B3u;
+    }
+    return hash;
+}
+
 void string_description_to_done_commit(struct CharBuffer *string)
 {
     const char *verbs[] =
@@ -297,7 +375,7 @@ void string_description_to_remove_commit(struct CharBuffer *string)
 
 bool string_resolve(size_t *index, const char *option, const char *const *options, size_t options_size)
 {
-    //All options can be (so far) resolved by the first letter, so don't care about ambiguity
+    //First match wins, so order of options decides ambiguity
     const size_t option_length = strlen(option);
     for (size_t i = 0; i < options_size; i++)
     {
@@ -0,0 +1,162 @@
+#include "kpd.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Needed by tag_push, tag_contains and tag_valid
+static size_t tag_length(const char *p)
+{
+    //Sigil and letter, then letters, digits and '_-./:', trailing punctuation is not part of tag
+    if ((*p != '+' && *p != '@') || !isalpha((unsigned char)p[1])) return 0;
+    size_t length = 2;
+    while (isalnum((unsigned char)p[length]) || (p[length] != '\0' && strchr("_-./:", p[length]) != NULL)) length++;
+    while (strchr(".:/", p[length - 1]) != NULL) length--;
+
+    //@ and 4 to 16 lowercase hexadecimal digits is @ID
+    if (*p == '@' && length >= 5 && length <= 17 && strspn(p + 1, "0123456789abcdef") >= length - 1) return 0;
+    return length;
+}
+
+static const char *tag_next(size_t *length, const char *p, const char *description)
+{
+    //Tags begin words, references of dependency markers are skipped
+    const char *marker = strstr(p, GRAPH_MARKER);
+    for (p = strpbrk(p, "+@"); p != NULL; p = strpbrk(p + 1, "+@"))
+    {
+        while (marker != NULL && p > marker)
+        {
+            const char *end = strchr(marker, ')');
+            if (end == NULL) return NULL;
+            if (p < end) p = end;
+            marker = strstr(end, GRAPH_MARKER);
+        }
+        if (*p == ')') continue;
+        if (p > description && !isspace((unsigned char)p[-1])) continue;
+        *length = tag_length(p);
+        if (*length > 0) return p;
+    }
+    return NULL;
+}
+
+static bool tag_equal(const char *p, size_t length, const char *name)
+{
+    //Name is in lower case
+    for (size_t i = 0; i < length; i++)
+    {
+        if (tolower((unsigned char)p[i]) != name[i]) return false;
+    }
+    return name[length] == '\0';
+}
+
+static size_t tag_slot(const struct TagIndex *index, const char *p, size_t length)
+{
+    //FNV-1a of lower case name, open addressing with linear probing
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ (unsigned char)tolower((unsigned char)p[i])) * 0x100000001b3;
+    size_t slot = (size_t)hash & (index->slots_capacity - 1);
+    while (index->slots[slot] != SIZE_MAX && !tag_equal(p, length, index->names.p + index->offsets[index->slots[slot]]))
+        slot = (slot + 1) & (index->slots_capacity - 1);
+    return slot;
+}
+
+static void tag_rehash(struct TagIndex *index)
+{
+    //At most half full
+    index->slots_capacity = (index->slots_capacity == 0) ? 16 : (2 * index->slots_capacity);
+    free(index->slots);
+    index->slots = malloc(index->slots_capacity * sizeof(*index->slots));
+    if (index->slots == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    for (size_t i = 0; i < index->slots_capacity; i++) index->slots[i] = SIZE_MAX;
+    for (size_t tag = 0; tag < index->size; tag++)
+    {
+        const char *name = index->names.p + index->offsets[tag];
+        index->slots[tag_slot(index, name, strlen(name))] = tag;
+    }
+}
+
+static size_t tag_intern(struct TagIndex *index, const char *p, size_t length)
+{
+    if (2 * (index->size + 1) > index->slots_capacity) tag_rehash(index);
+    const size_t slot = tag_slot(index, p, length);
+    if (index->slots[slot] != SIZE_MAX) return index->slots[slot];
+
+    //New tag without entries
+    if (index->size == index->capacity)
+    {
+        index->capacity = (index->capacity == 0) ? 16 : (2 * index->capacity);
+        size_t *new_offsets = realloc(index->offsets, index->capacity * sizeof(*index->offsets));
+        if (new_offsets == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        index->offsets = new_offsets;
+        uint64_t **new_postings = realloc(index->postings, index->capacity * sizeof(*index->postings));
+        if (new_postings == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        index->postings = new_postings;
+        size_t *new_words = realloc(index->words, index->capacity * sizeof(*index->words));
+        if (new_words == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+        index->words = new_words;
+    }
+    const size_t tag = index->size++;
+    index->offsets[tag] = index->names.size;
+    string_substitute(&index->names, index->names.size, 0, p, length);
+    for (size_t i = index->offsets[tag]; i < index->names.size; i++) index->names.p[i] = (char)tolower((unsigned char)index->names.p[i]);
+    string_substitute(&index->names, index->names.size, 0, "", 1);
+    index->postings[tag] = NULL;
+    index->words[tag] = 0;
+    index->slots[slot] = tag;
+    return tag;
+}
+
+void tag_push(struct TagIndex *index, const char *description, size_t entry)
+{
+    size_t length;
+    for (const char *p = tag_next(&length, description, description); p != NULL; p = tag_next(&length, p + length, description))
+    {
+        //Bitsets grow to last entry with tag, missing words are zero
+        const size_t tag = tag_intern(index, p, length);
+        const size_t word = entry / 64;
+        if (word >= index->words[tag])
+        {
+            size_t new_words = (index->words[tag] == 0) ? 1 : (2 * index->words[tag]);
+            while (word >= new_words) new_words <<= 1;
+            uint64_t *new_posting = realloc(index->postings[tag], new_words * sizeof(*new_posting));
+            if (new_posting == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+            memset(new_posting + index->words[tag], 0, (new_words - index->words[tag]) * sizeof(*new_posting));
+            index->postings[tag] = new_posting;
+            index->words[tag] = new_words;
+        }
+        index->postings[tag][word] |= (uint64_t)1 << (entry % 64);
+    }
+}
+
+size_t tag_find(const struct TagIndex *index, const char *name)
+{
+    if (index->size == 0) return SIZE_MAX;
+    return index->slots[tag_slot(index, name, strlen(name))];
+}
+
+bool tag_contains(const char *description, const char *name)
+{
+    size_t length;
+    for (const char *p = tag_next(&length, description, description); p != NULL; p = tag_next(&length, p + length, description))
+    {
+        if (tag_equal(p, length, name)) return true;
+    }
+    return false;
+}
+
+bool tag_valid(const char *name)
+{
+    return tag_length(name) == strlen(name);
+}
+
+void tag_finalize(struct TagIndex *index)
+{
+    for (size_t tag = 0; tag < index->size; tag++) free(index->postings[tag]);
+    free(index->postings);
+    free(index->words);
+    free(index->offsets);
+    free(index->slots);
+    free(index->names.p);
+    memset(index, 0, sizeof(*index));
+}
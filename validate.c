@@ -0,0 +1,390 @@
+#include "kpd.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+///State of one pass over raw contents of TODO.md
+struct Validator
+{
+    void *report;           ///< FILE* for problems
+    void *fix;              ///< FILE* for fixed contents, NULL for none
+    const char *name;       ///< Name of file in problems
+    size_t line;            ///< Number of current line, from 1
+    const char *begin;      ///< Beginning of current line
+    const char *written;    ///< Contents before this are written to fix
+    int crlf;               ///< Line end of first line: 1 for CRLF, 0 for LF, -1 before first line end
+    size_t *counts;         ///< Problems found and fixed
+    struct ProblemBuffer *problems; ///< Problems are appended here instead of printed, NULL for none
+};
+
+//Needed by validate_line and validate_graph
+static void validate_report(struct Validator *validator, const char *at, bool fixable, const char *format, ...)
+{
+    //Same form as compiler diagnostics, column counts bytes
+    va_list va;
+    va_start(va, format);
+    if (validator->problems != NULL)
+    {
+        struct ProblemBuffer *problems = validator->problems;
+        if (problems->size == problems->capacity)
+        {
+            problems->capacity = (problems->capacity == 0) ? 16 : (2 * problems->capacity);
+            struct Problem *new_p = realloc(problems->p, problems->capacity * sizeof(*problems->p));
+            if (new_p == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+            problems->p = new_p;
+        }
+        struct Problem *problem = &problems->p[problems->size++];
+        problem->line = validator->line;
+        problem->column = (size_t)(at - validator->begin + 1);
+        problem->fixable = fixable;
+        vsnprintf(problem->message, sizeof(problem->message), format, va);
+    }
+    else if (validator->report != NULL)
+    {
+        fprintf(validator->report, "%s:%u:%u: ", validator->name, (unsigned int)validator->line, (unsigned int)(at - validator->begin + 1));
+        vfprintf(validator->report, format, va);
+        fputs((fixable && validator->fix != NULL) ? " (fixed)\n" : "\n", validator->report);
+    }
+    va_end(va);
+    validator->counts[0]++;
+    if (fixable && validator->fix != NULL) validator->counts[1]++;
+}
+
+static void validate_replace(struct Validator *validator, const char *begin, const char *end, const char *substitution, size_t substitution_size)
+{
+    //Problems are found in order, so contents are copied up to every replaced segment
+    if (validator->fix == NULL) return;
+    fwrite(validator->written, 1, (size_t)(begin - validator->written), validator->fix);
+    fwrite(substitution, 1, substitution_size, validator->fix);
+    validator->written = end;
+}
+
+static bool validate_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static const char *validate_checkbox(struct Validator *validator, const char *p, const char *end)
+{
+    //Lines that look like list items with checkbox, returns beginning of description (NULL for other lines)
+    const char *bullet = p;
+    while (bullet < end && validate_space(*bullet)) bullet++;
+    if (bullet == end || (*bullet != '-' && *bullet != '*' && *bullet != '+')) return NULL;
+    const char *box = bullet + 1;
+    while (box < end && validate_space(*box)) box++;
+    if (box == end || *box != '[') return NULL;
+    const char *mark = box + 1;
+    const char *close = (mark < end && (*mark == ' ' || *mark == 'x' || *mark == 'X')) ? (mark + 1) : mark;
+    if (close == end || *close != ']') return NULL;
+    const char *description = close + 1;
+    while (description < end && validate_space(*description)) description++;
+
+    //First difference from " - [ ] ", same beginning as in kpd_read_line
+    const char *at = NULL;
+    if (bullet != p + 1 || *p != ' ') at = (*p == ' ') ? (p + 1) : p;
+    else if (*bullet != '-') at = bullet;
+    else if (box != bullet + 2 || bullet[1] != ' ') at = bullet + 1;
+    else if (mark == close || *mark == 'x') at = mark;
+    else if (close + 1 == end || close[1] != ' ') at = close + 1;
+    if (at == NULL) return description;
+
+    //Fixed checkbox needs description
+    if (description == end)
+    {
+        validate_report(validator, at, false, "task without description");
+        return NULL;
+    }
+    validate_report(validator, at, true, "malformed checkbox");
+    validate_replace(validator, p, description, (mark == close || *mark == ' ') ? " - [ ] " : " - [X] ", 7);
+    return description;
+}
+
+//Needed by validate_markers
+static const char *validate_due(struct Validator *validator, const char *p, const char *end, bool *found)
+{
+    //Date must exist, returns end of marker (NULL if unterminated)
+    const size_t prefix_length = strlen("(due:");
+    const char *close = memchr(p, ')', (size_t)(end - p));
+    if (close == NULL)
+    {
+        validate_report(validator, p, false, "unterminated due marker");
+        return NULL;
+    }
+    const char *value = p + prefix_length;
+    while (value < close && validate_space(*value)) value++;
+    const char *value_end = close;
+    while (value_end > value && validate_space(value_end[-1])) value_end--;
+    const size_t value_length = (size_t)(value_end - value);
+    const char *next = close + 1;
+    if (value_length != 10 || due_parse(value) == 0)
+    {
+        validate_report(validator, value, false, "invalid due date '%.*s'", (int)value_length, value);
+    }
+    else if (*found)
+    {
+        validate_report(validator, p, true, "duplicate due marker");
+        const char *begin = (p > validator->written && p[-1] == ' ') ? (p - 1) : p;
+        validate_replace(validator, begin, next, "", 0);
+    }
+    else
+    {
+        char marker[sizeof(DUE_MARKER) + 11];
+        snprintf(marker, sizeof(marker), DUE_MARKER "%.10s)", value);
+        const size_t marker_length = strlen(marker);
+        if ((size_t)(next - p) != marker_length || memcmp(p, marker, marker_length) != 0)
+        {
+            validate_report(validator, p, true, "malformed due marker");
+            validate_replace(validator, p, next, marker, marker_length);
+        }
+        *found = true;
+    }
+    return next;
+}
+
+static void validate_markers(struct Validator *validator, const char *p, const char *end)
+{
+    //Exactly one of the markers recognized by kpd_read_line of each kind
+    const char *markers[4] = { "(priority: low)", "(priority: medium)", "(priority: high)", "(priority: critical)" };
+    const size_t prefix_length = strlen("(priority:");
+    bool found = false;
+    bool due_found = false;
+    while ((p = memchr(p, '(', (size_t)(end - p))) != NULL)
+    {
+        if ((size_t)(end - p) >= strlen("(due:") && strncasecmp(p, "(due:", strlen("(due:")) == 0)
+        {
+            p = validate_due(validator, p, end, &due_found);
+            if (p == NULL) return;
+            continue;
+        }
+        if ((size_t)(end - p) < prefix_length || strncasecmp(p, "(priority:", prefix_length) != 0)
+        {
+            p++;
+            continue;
+        }
+        const char *close = memchr(p, ')', (size_t)(end - p));
+        if (close == NULL)
+        {
+            validate_report(validator, p, false, "unterminated priority marker");
+            return;
+        }
+
+        //Value ignoring case and spaces
+        const char *value = p + prefix_length;
+        while (value < close && validate_space(*value)) value++;
+        const char *value_end = close;
+        while (value_end > value && validate_space(value_end[-1])) value_end--;
+        const size_t value_length = (size_t)(value_end - value);
+        unsigned int priority = 4;
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            if (strlen(kpd_priority_strings[i]) == value_length && strncasecmp(value, kpd_priority_strings[i], value_length) == 0) priority = i;
+        }
+        const char *next = close + 1;
+
+        //Unknown, duplicate or not written as kpd writes it
+        if (priority == 4)
+        {
+            validate_report(validator, value, false, "unknown priority '%.*s'", (int)value_length, value);
+        }
+        else if (found)
+        {
+            validate_report(validator, p, true, "duplicate priority marker");
+            const char *begin = (p > validator->written && p[-1] == ' ') ? (p - 1) : p;
+            validate_replace(validator, begin, next, "", 0);
+        }
+        else
+        {
+            const size_t marker_length = strlen(markers[priority]);
+            if ((size_t)(next - p) != marker_length || memcmp(p, markers[priority], marker_length) != 0)
+            {
+                validate_report(validator, p, true, "malformed priority marker");
+                validate_replace(validator, p, next, markers[priority], marker_length);
+            }
+            found = true;
+        }
+        p = next;
+    }
+}
+
+static void validate_graph(struct Validator *validator, const char *p, size_t size)
+{
+    //Tasks are parsed only if some line has dependencies
+    const char *end = p + size;
+    if (size == 0 || strstr(p, GRAPH_MARKER) == NULL) return;
+    const char *task;
+    unsigned char flags;
+    size_t tasks = 0;
+    for (const char *endline = count_task(&flags, &task, p, end); endline != NULL; endline = count_task(&flags, &task, endline, end)) tasks++;
+    //Descriptions without markers like kpd_read_line gives them, so @IDs match id.c
+    struct EntryBuffer entries = { 0 };
+    entries_set_size(&entries, tasks);
+    struct CharBuffer task_line = { 0 };
+    size_t i = 0;
+    for (const char *endline = count_task(&flags, &task, p, end); endline != NULL && i < tasks; endline = count_task(&flags, &task, endline, end), i++)
+    {
+        string_set_size(&task_line, (size_t)(endline - task));
+        memcpy(task_line.p, task, task_line.size);
+        struct Entry entry = { 0 };
+        char *description = strdup(kpd_read_line(&entry, &task_line) ? entry.description : "");
+        if (description == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+        entry.number = i;
+        entries.p[i] = entry;
+        entries.p[i].description = description;
+    }
+    entries.size = i;
+    free(task_line.p);
+
+    //Unresolved references and cycles, reported at first marker of dependent task (edges are ordered by dependent)
+    struct Graph graph;
+    graph_build(&graph, &entries);
+    char *cycles = malloc(entries.size + 1);
+    if (cycles == NULL) kpd_error(ERR_MALLOC, "malloc() failed");
+    graph_cycles(cycles, &graph);
+    const char *line = p;
+    validator->line = 1;
+    size_t edge = 0;
+    i = 0;
+    for (const char *endline = count_task(&flags, &task, p, end); endline != NULL && i < entries.size; endline = count_task(&flags, &task, endline, end), i++)
+    {
+        for (; line < task; line++) validator->line += (*line == '\n');
+        validator->begin = task;
+        const char *marker = strstr(task, GRAPH_MARKER);
+        for (; edge < graph.edges && graph.targets[edge] == i; edge++)
+        {
+            if (graph.sources[edge] == SIZE_MAX) validate_report(validator, marker, false, "dependency matches no task");
+        }
+        if (cycles[i]) validate_report(validator, marker, false, "dependency cycle");
+    }
+
+    //Cleanup
+    free(cycles);
+    graph_finalize(&graph);
+    entries_finalize(&entries, true);
+}
+
+//Needed by validate_scan and validate_lines
+static const char *validate_line(struct Validator *validator, const char *p, const char *end)
+{
+    //Line without line end and trailing spaces
+    validator->line++;
+    validator->begin = p;
+    const char *endline = memchr(p, '\n', (size_t)(end - p));
+    if (endline == NULL) endline = end;
+    const bool newline = endline != end;
+    const char *content_end = (newline && endline > p && endline[-1] == '\r') ? (endline - 1) : endline;
+    const char *trailing = content_end;
+    while (trailing > p && validate_space(trailing[-1])) trailing--;
+
+    //Tasks
+    const char *description = validate_checkbox(validator, p, trailing);
+    if (description != NULL) validate_markers(validator, description, trailing);
+
+    //Trailing spaces
+    if (trailing != content_end)
+    {
+        validate_report(validator, trailing, true, "trailing whitespace");
+        validate_replace(validator, trailing, content_end, "", 0);
+    }
+
+    //Line ends follow first line
+    const bool crlf = content_end != endline;
+    if (newline && validator->crlf < 0) validator->crlf = crlf;
+    else if (newline && validator->crlf != crlf)
+    {
+        validate_report(validator, content_end, true, crlf ? "line ends with CRLF, first line with LF" : "line ends with LF, first line with CRLF");
+        validate_replace(validator, content_end, endline + 1, validator->crlf ? "\r\n" : "\n", validator->crlf ? 2 : 1);
+    }
+    else if (!newline)
+    {
+        validate_report(validator, content_end, true, "missing newline at end of file");
+        validate_replace(validator, end, end, (validator->crlf == 1) ? "\r\n" : "\n", (validator->crlf == 1) ? 2 : 1);
+    }
+    return newline ? (endline + 1) : end;
+}
+
+void validate_scan(size_t counts[2], void *report, const char *name, const char *p, size_t size, void *fix)
+{
+    struct Validator validator = { report, fix, name, 0, p, p, -1, counts, NULL };
+    counts[0] = 0;
+    counts[1] = 0;
+    const char *end = p + size;
+    while (p < end) p = validate_line(&validator, p, end);
+    if (fix != NULL) fwrite(validator.written, 1, (size_t)(end - validator.written), fix);
+
+    //Dependencies need every task
+    validate_graph(&validator, end - size, size);
+}
+
+void validate_lines(struct ProblemBuffer *problems, const char *p, size_t size, size_t line, int crlf)
+{
+    size_t counts[2] = { 0, 0 };
+    struct Validator validator = { NULL, NULL, NULL, line - 1, p, p, crlf, counts, problems };
+    const char *end = p + size;
+    while (p < end) p = validate_line(&validator, p, end);
+}
+
+void validate_dependencies(struct ProblemBuffer *problems, const char *p, size_t size)
+{
+    size_t counts[2] = { 0, 0 };
+    struct Validator validator = { NULL, NULL, NULL, 0, p, p, -1, counts, problems };
+    validate_graph(&validator, p, size);
+}
+
+void validate_revisions(size_t counts[2], const char *path, char *const *revisions, size_t revisions_size)
+{
+    //One git process answers every revision, blobs are read into one buffer
+    char *arguments[4] = { "git", "cat-file", "--batch", NULL };
+    FILE *input;
+    int id;
+    FILE *output = kpd_open_git_batch(arguments, &input, &id);
+    const char *relative = (strncmp(path, "../", 3) == 0) ? "" : "./";
+    struct CharBuffer header = { 0 };
+    struct CharBuffer content = { 0 };
+    struct CharBuffer name = { 0 };
+    string_set_size(&header, INITIAL_BUFFER_SIZE);
+    for (size_t i = 0; i < revisions_size; i++)
+    {
+        //Path relative to current directory, every answer is read before next request
+        if (strchr(revisions[i], '\n') != NULL) kpd_error(ERR_USAGE, "revision must not contain line ends");
+        fprintf(input, "%s:%s%s\n", revisions[i], relative, path);
+        if (fflush(input) != 0) kpd_error(ERR_GIT, "'git cat-file' failed");
+        if (!string_set_line(&header, output)) kpd_error(ERR_GIT, "'git cat-file' failed");
+        string_set_size(&name, 0);
+        string_substitute(&name, 0, 0, revisions[i], strlen(revisions[i]));
+        string_substitute(&name, name.size, 0, ":", 1);
+        string_substitute(&name, name.size, 0, path, strlen(path));
+
+        //Answer is "<object> missing" or "<oid> <type> <size>" followed by contents
+        const char *type = strchr(header.p, ' ');
+        const char *size_string = (type == NULL) ? NULL : strchr(type + 1, ' ');
+        if (size_string == NULL || strcmp(size_string, " missing\n") == 0 || strcmp(size_string, " ambiguous\n") == 0)
+        {
+            printf("%s: not found\n", name.p);
+            counts[0]++;
+            continue;
+        }
+        string_set_size(&content, (size_t)strtoull(size_string + 1, NULL, 10));
+        if (fread(content.p, 1, content.size, output) != content.size || fgetc(output) != '\n') kpd_error(ERR_GIT, "'git cat-file' failed");
+        if (strncmp(type, " blob ", 6) != 0)
+        {
+            printf("%s: not a file\n", name.p);
+            counts[0]++;
+            continue;
+        }
+
+        //Same checks as for working tree
+        size_t revision_counts[2];
+        validate_scan(revision_counts, stdout, name.p, content.p, content.size, NULL);
+        counts[0] += revision_counts[0];
+    }
+
+    //Cleanup
+    fclose(input);
+    kpd_close_git(output, id);
+    free(name.p);
+    free(content.p);
+    free(header.p);
+}
@@ -0,0 +1,286 @@
+#include "kpd.h"
+
+#include <sys/inotify.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+///Parsed TODO.md, kept between changes
+struct Snapshot
+{
+    struct CharBuffer content;  ///< Contents of TODO.md
+    struct EntryBuffer entries; ///< Entries parsed from content
+    size_t *offsets;            ///< Offsets of entry lines in content
+    size_t offsets_capacity;    ///< Allocated size of offsets
+};
+
+///Output of command, split to rows
+struct Screen
+{
+    struct CharBuffer output;   ///< Output of command, ends with '\n' unless empty
+    size_t *rows;               ///< Offsets of rows in output, followed by output size
+    size_t size;                ///< Number of rows
+    size_t capacity;            ///< Allocated size of rows
+};
+
+//Needed by watch_update and watch_render
+static void watch_reserve(size_t **p, size_t *capacity, size_t size)
+{
+    if (size <= *capacity) return;
+    size_t new_capacity = (*capacity == 0) ? 1 : *capacity;
+    while (size > new_capacity) new_capacity <<= 1;
+    size_t *new_p = realloc(*p, new_capacity * sizeof(**p));
+    if (new_p == NULL) kpd_error(ERR_REALLOC, "realloc() failed");
+    *capacity = new_capacity;
+    *p = new_p;
+}
+
+//Needed by watch_update
+static bool watch_boundary(const char *content, size_t offset)
+{
+    return offset == 0 || content[offset - 1] == '\n';
+}
+
+static size_t watch_lower_bound(const size_t *offsets, size_t size, size_t offset)
+{
+    size_t begin = 0, end = size;
+    while (begin < end)
+    {
+        const size_t middle = begin + (end - begin) / 2;
+        if (offsets[middle] < offset) begin = middle + 1;
+        else end = middle;
+    }
+    return begin;
+}
+
+static bool watch_update(struct Snapshot *snapshot, struct CharBuffer *content)
+{
+    //Find changed bytes, first snapshot is empty
+    const char *old_p = (snapshot->content.p != NULL) ? snapshot->content.p : "";
+    const char *new_p = content->p;
+    const size_t old_size = snapshot->content.size;
+    const size_t new_size = content->size;
+    const size_t min_size = (old_size < new_size) ? old_size : new_size;
+    size_t prefix = 0;
+    while (prefix < min_size && old_p[prefix] == new_p[prefix]) prefix++;
+    if (prefix == old_size && prefix == new_size) return false;
+    size_t suffix = 0;
+    while (suffix < min_size - prefix && old_p[old_size - suffix - 1] == new_p[new_size - suffix - 1]) suffix++;
+
+    //Extend changed bytes to whole lines
+    size_t begin = prefix;
+    while (!watch_boundary(new_p, begin)) begin--;
+    size_t old_end = old_size - suffix;
+    size_t new_end = new_size - suffix;
+    while (old_end < old_size && !(watch_boundary(old_p, old_end) && watch_boundary(new_p, new_end))) { old_end++; new_end++; }
+
+    //Parse changed lines only
+    struct EntryBuffer parsed = { 0 };
+    size_t *parsed_offsets = NULL;
+    size_t parsed_offsets_capacity = 0;
+    struct CharBuffer line = { 0 };
+    for (size_t line_begin = begin; line_begin < new_end;)
+    {
+        const char *endline = memchr(new_p + line_begin, '\n', new_end - line_begin);
+        const size_t line_end = (endline == NULL) ? new_end : (size_t)(endline - new_p) + 1;
+        string_set_size(&line, line_end - line_begin);
+        memcpy(line.p, new_p + line_begin, line.size);
+        struct Entry entry = { 0 };
+        if (kpd_read_line(&entry, &line))
+        {
+            entry.description = strdup(entry.description);
+            if (entry.description == NULL) kpd_error(ERR_MALLOC, "strdup() failed");
+            entries_set_size(&parsed, parsed.size + 1);
+            parsed.p[parsed.size - 1] = entry;
+            watch_reserve(&parsed_offsets, &parsed_offsets_capacity, parsed.size);
+            parsed_offsets[parsed.size - 1] = line_begin;
+        }
+        line_begin = line_end;
+    }
+
+    //Replace entries of changed lines
+    struct EntryBuffer *entries = &snapshot->entries;
+    const size_t first = watch_lower_bound(snapshot->offsets, entries->size, begin);
+    const size_t last = watch_lower_bound(snapshot->offsets, entries->size, old_end);
+    for (size_t i = first; i < last; i++) free(entries->p[i].description);
+    const size_t old_count = entries->size;
+    const size_t new_count = old_count - (last - first) + parsed.size;
+    if (new_count > old_count) entries_set_size(entries, new_count);
+    watch_reserve(&snapshot->offsets, &snapshot->offsets_capacity, new_count);
+    if (last < old_count)
+    {
+        memmove(entries->p + first + parsed.size, entries->p + last, (old_count - last) * sizeof(*entries->p));
+        memmove(snapshot->offsets + first + parsed.size, snapshot->offsets + last, (old_count - last) * sizeof(*snapshot->offsets));
+    }
+    if (parsed.size > 0)
+    {
+        memcpy(entries->p + first, parsed.p, parsed.size * sizeof(*entries->p));
+        memcpy(snapshot->offsets + first, parsed_offsets, parsed.size * sizeof(*snapshot->offsets));
+    }
+    entries->size = new_count;
+
+    //Renumber and shift following entries
+    for (size_t i = first; i < new_count; i++) entries->p[i].number = i;
+    for (size_t i = first + parsed.size; i < new_count; i++) snapshot->offsets[i] = snapshot->offsets[i] - old_end + new_end;
+
+    //Keep content for next comparison
+    const struct CharBuffer old_content = snapshot->content;
+    snapshot->content = *content;
+    *content = old_content;
+
+    //Cleanup
+    free(line.p);
+    free(parsed_offsets);
+    entries_finalize(&parsed, false);
+    return true;
+}
+
+//Needed by watch_run
+static void watch_render(struct Screen *screen, Command *command, int argc, char **argv, const struct EntryBuffer *entries)
+{
+    //Run command in child process, it may modify arguments and exit on error
+    int pipe_ends[2];
+    if (pipe(pipe_ends) < 0) kpd_error(ERR_PIPE, "pipe() failed");
+    fflush(stdout);
+    const pid_t id = fork();
+    if (id < 0)
+    {
+        kpd_error(ERR_FORK, "fork() failed");
+    }
+    else if (id == 0)
+    {
+        close(pipe_ends[0]);
+        if (dup2(pipe_ends[1], STDOUT_FILENO) < 0 || dup2(pipe_ends[1], STDERR_FILENO) < 0) kpd_error(ERR_DUP, "dup2() failed");
+        close(pipe_ends[1]);
+        kpd_set_source(SRC_MEMORY, entries);
+        exit(command(argc, argv));
+    }
+
+    //Read output
+    close(pipe_ends[1]);
+    struct CharBuffer *output = &screen->output;
+    string_set_size(output, INITIAL_BUFFER_SIZE);
+    size_t size = 0;
+    while (true)
+    {
+        if (size == output->size) string_set_size(output, 2 * size);
+        const ssize_t result = read(pipe_ends[0], output->p + size, output->size - size);
+        if (result < 0) kpd_error(ERR_PIPE, "read() failed");
+        if (result == 0) break;
+        size += (size_t)result;
+    }
+    close(pipe_ends[0]);
+    int status;
+    if (waitpid(id, &status, 0) < 0) kpd_error(ERR_WAIT, "waitpid() failed");
+    string_set_size(output, size);
+    if (size > 0 && output->p[size - 1] != '\n') string_substitute(output, size, 0, "\n", 1);
+
+    //Split to rows
+    screen->size = 0;
+    for (size_t row = 0; row < output->size; screen->size++)
+    {
+        watch_reserve(&screen->rows, &screen->capacity, screen->size + 2);
+        screen->rows[screen->size] = row;
+        row = (size_t)((char*)memchr(output->p + row, '\n', output->size - row) - output->p) + 1;
+    }
+    watch_reserve(&screen->rows, &screen->capacity, screen->size + 1);
+    screen->rows[screen->size] = output->size;
+}
+
+static void watch_draw(const struct Screen *old_screen, const struct Screen *new_screen)
+{
+    //Rewrite changed rows only
+    for (size_t i = 0; i < new_screen->size; i++)
+    {
+        const char *new_row = new_screen->output.p + new_screen->rows[i];
+        const size_t new_row_size = new_screen->rows[i + 1] - new_screen->rows[i] - 1;
+        if (i < old_screen->size)
+        {
+            const char *old_row = old_screen->output.p + old_screen->rows[i];
+            const size_t old_row_size = old_screen->rows[i + 1] - old_screen->rows[i] - 1;
+            if (old_row_size == new_row_size && memcmp(old_row, new_row, new_row_size) == 0) continue;
+        }
+        printf("\x1b[%u;1H", (unsigned int)(i + 1));
+        fwrite(new_row, 1, new_row_size, stdout);
+        printf("\x1b[K");
+    }
+
+    //Clear rows that disappeared
+    printf("\x1b[%u;1H", (unsigned int)(new_screen->size + 1));
+    if (old_screen->size > new_screen->size) printf("\x1b[J");
+    fflush(stdout);
+}
+
+int watch_run(Command *command, int argc, char **argv)
+{
+    if (kpd_get_source() != SRC_FILE) kpd_error(ERR_USAGE, "watch is not available when reading standard input");
+    if (kpd_get_section() != NULL) kpd_error(ERR_USAGE, "watch is not available for sections");
+
+    //Find TODO.md and its directory
+    struct CharBuffer path = { 0 };
+    kpd_find_target(&path);
+    struct CharBuffer directory = { 0 };
+    string_substitute(&directory, 0, 0, path.p, path.size);
+    if (!string_remove_file(&directory))
+    {
+        string_set_size(&directory, 0);
+        string_substitute(&directory, 0, 0, ".", 1);
+    }
+
+    //Watch directory, editors often save by renaming a new file over the old one
+    const int inotify = inotify_init1(IN_CLOEXEC);
+    if (inotify < 0) kpd_error(ERR_WATCH, "inotify_init1() failed");
+    if (inotify_add_watch(inotify, directory.p, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+        kpd_error(ERR_WATCH, "inotify_add_watch() failed");
+
+    //Redraw on change
+    struct Snapshot snapshot = { 0 };
+    struct CharBuffer content = { 0 };
+    struct Screen screens[2] = { 0 };
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool first = true;
+    bool changed = true;
+    printf("\x1b[H\x1b[2J");
+    while (true)
+    {
+        if (changed && string_set_file(&content, path.p) && (watch_update(&snapshot, &content) || first))
+        {
+            watch_render(&screens[1], command, argc, argv, &snapshot.entries);
+            watch_draw(&screens[0], &screens[1]);
+            const struct Screen screen = screens[0];
+            screens[0] = screens[1];
+            screens[1] = screen;
+            first = false;
+        }
+
+        //Wait for events, handle all pending at once
+        const ssize_t size = read(inotify, events, sizeof(events));
+        if (size < 0) break;
+        changed = false;
+        for (const char *event_p = events; event_p < events + size;)
+        {
+            const struct inotify_event *event = (const struct inotify_event*)event_p;
+            if (event->len > 0 && strcmp(event->name, TARGET) == 0) changed = true;
+            event_p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    //Cleanup, watching only ends on error
+    close(inotify);
+    for (size_t i = 0; i < 2; i++)
+    {
+        free(screens[i].output.p);
+        free(screens[i].rows);
+    }
+    free(snapshot.content.p);
+    free(snapshot.offsets);
+    entries_finalize(&snapshot.entries, true);
+    free(content.p);
+    free(directory.p);
+    free(path.p);
+    kpd_error(ERR_WATCH, "read() failed");
+}